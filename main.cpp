@@ -3,17 +3,49 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb/stb_truetype.h>
 #include <json/json.h>
 #include <fstream>
+#include <sys/stat.h>
+#include <cstring>
+#include <cstddef>
 
 #include <iostream>
 #include <vector>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <utility>
 #include <random>
 #include <ctime>
+#include <cmath>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h> // AVX2 paths are compiled per function and picked at runtime
+#endif
+
+// Headless builds (-DFLAPPY_HEADLESS, link -lEGL) render into an FBO on a surfaceless EGL context
+#ifdef FLAPPY_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 using json = nlohmann::json;
 
@@ -36,6 +68,7 @@ const float PIPE_SPAWN_X = 10.0f;
 const float PIPE_DISTANCE = 6.0f;
 const float PIPE_GAP = 2.5f;
 const float PIPE_WIDTH = 1.0f;
+const float PIPE_LENGTH = 10.0f; // drawn length of each half, enough to leave the screen
 
 // Shaders
 const char* vertexShaderSource = R"(
@@ -43,22 +76,65 @@ const char* vertexShaderSource = R"(
     layout (location = 0) in vec3 aPos;
     layout (location = 1) in vec3 aNormal;
     layout (location = 2) in vec2 aTexCoords;
+    layout (location = 3) in uvec4 aJoints;
+    layout (location = 4) in vec4 aWeights;
+    layout (location = 5) in float aMaterial;
+    layout (location = 6) in vec4 aInstance;
 
     out vec3 Normal;
     out vec3 FragPos;
     out vec2 TexCoords;
+    out vec3 MaterialColor;
+    flat out vec4 MaterialRect;
 
     uniform mat4 model;
     uniform mat4 view;
     uniform mat4 projection;
     uniform vec2 texOffset;
     uniform vec2 texScale;
+    uniform bool skinned;
+    uniform bool useMaterials;
+    // Instanced draws are pipes: aInstance is (x, gap edge y, direction, 0) and
+    // pipeShape is (model top, stretch start, scale, body stretch)
+    uniform bool instanced;
+    uniform vec4 pipeShape;
+
+    layout (std140) uniform JointPalette {
+        mat4 joints[128];
+    };
+
+    // Slot 0 is white, which is also what meshes without a material stream read.
+    // A zero rect means the material is untextured and uses the draw's atlasRect.
+    layout (std140) uniform Materials {
+        vec4 materialColors[16];
+        vec4 materialRects[16];
+    };
 
     void main()
     {
-        FragPos = vec3(model * vec4(aPos, 1.0));
-        Normal = mat3(transpose(inverse(model))) * aNormal;  
+        vec3 position = aPos;
+        vec3 normal = aNormal;
+        if (instanced) {
+            // Lengthen the body below the cap, hang the cap on the gap edge, mirror top pipes
+            position.y += min(position.y - pipeShape.y, 0.0) * (pipeShape.w - 1.0);
+            position = vec3(position.x, position.y - pipeShape.x, position.z) * pipeShape.z;
+            position.y *= aInstance.z;
+            position += vec3(aInstance.xy, 0.0);
+            normal.y *= aInstance.z;
+        }
+
+        mat4 skin = mat4(1.0);
+        float weightSum = dot(aWeights, vec4(1.0));
+        if (skinned && weightSum > 0.0) { // rigid submeshes have no weights
+            skin = aWeights.x * joints[aJoints.x] + aWeights.y * joints[aJoints.y] +
+                   aWeights.z * joints[aJoints.z] + aWeights.w * joints[aJoints.w];
+            skin /= weightSum; // unorm8 weights don't sum to exactly one
+        }
+        FragPos = vec3(model * skin * vec4(position, 1.0));
+        Normal = mat3(transpose(inverse(model))) * mat3(skin) * normal;  
         TexCoords = aTexCoords * texScale + texOffset;
+        MaterialColor = useMaterials ? materialColors[int(aMaterial)].rgb : vec3(1.0);
+        MaterialRect = useMaterials ? materialRects[int(aMaterial)] : vec4(0.0);
         gl_Position = projection * view * vec4(FragPos, 1.0);
     }
 )";
@@ -70,12 +146,15 @@ const char* fragmentShaderSource = R"(
     in vec3 Normal;
     in vec3 FragPos;
     in vec2 TexCoords;
+    in vec3 MaterialColor;
+    flat in vec4 MaterialRect;
 
     uniform vec3 objectColor;
     uniform vec3 lightColor;
     uniform vec3 lightPos;
     uniform vec3 viewPos;
     uniform sampler2D texture1;
+    uniform vec4 atlasRect; // (u, v, width, height) of this object's image in the atlas
 
     void main()
     {
@@ -96,81 +175,154 @@ const char* fragmentShaderSource = R"(
         float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
         vec3 specular = specularStrength * lightColor * spec;  
         
-        vec4 texColor = texture(texture1, TexCoords);
-        vec3 result = (ambient + diffuse + specular) * objectColor * texColor.rgb;
+        // Repeat inside the atlas rect. Gradients come from the unwrapped
+        // coordinates so the fract() seam doesn't drop to the smallest mip.
+        vec4 rect = MaterialRect.z > 0.0 ? MaterialRect : atlasRect;
+        vec2 atlasCoords = rect.xy + fract(TexCoords) * rect.zw;
+        vec4 texColor = textureGrad(texture1, atlasCoords, dFdx(TexCoords) * rect.zw, dFdy(TexCoords) * rect.zw);
+        vec3 result = (ambient + diffuse + specular) * objectColor * MaterialColor * texColor.rgb;
         FragColor = vec4(result, 1.0);
     } 
 )";
 
-// Cube Vertices (Position + Normal + TexCoords)
+// Background Shader: one fullscreen triangle at the far plane. The sky is
+// treated as the old 50x35 textured plane behind the pipes, so scrolling,
+// parallax and lighting are reconstructed per pixel instead of rasterizing a cube.
+const char* bgVertexShaderSource = R"(
+    #version 330 core
+    out vec2 ScreenPos;
+
+    void main()
+    {
+        // (-1,-1), (3,-1), (-1,3) covers the whole viewport
+        vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+        ScreenPos = pos;
+        gl_Position = vec4(pos, 1.0, 1.0); // z = w puts it on the far plane
+    }
+)";
+
+const char* bgFragmentShaderSource = R"(
+    #version 330 core
+    out vec4 FragColor;
+
+    in vec2 ScreenPos;
+
+    uniform vec3 lightColor;
+    uniform vec3 lightPos;
+    uniform vec3 viewPos;
+    uniform sampler2DArray skyTextures;
+    uniform float layer;
+    uniform float previousLayer;
+    uniform float fade; // 0 shows previousLayer, 1 shows layer
+    uniform vec2 halfExtent; // half size of the visible sky plane in world units
+    uniform float scroll;
+
+    const float SKY_Z = -9.5;
+    const vec2 SKY_SIZE = vec2(50.0, 35.0);
+    const float PARALLAX = 0.8;
+
+    void main()
+    {
+        vec3 fragPos = vec3(viewPos.xy + ScreenPos * halfExtent, SKY_Z);
+        vec2 texCoords = vec2(0.5) + (fragPos.xy - vec2(0.0, viewPos.y * PARALLAX)) / SKY_SIZE;
+        texCoords.x += scroll;
+
+        // Same Phong terms as the scene shader, normal faces the camera
+        vec3 norm = vec3(0.0, 0.0, 1.0);
+        vec3 ambient = 0.5 * lightColor;
+        vec3 lightDir = normalize(lightPos - fragPos);
+        vec3 diffuse = max(dot(norm, lightDir), 0.0) * lightColor;
+        vec3 viewDir = normalize(viewPos - fragPos);
+        vec3 reflectDir = reflect(-lightDir, norm);
+        vec3 specular = 0.2 * lightColor * pow(max(dot(viewDir, reflectDir), 0.0), 32);
+
+        vec3 sky = mix(texture(skyTextures, vec3(texCoords, previousLayer)).rgb,
+                       texture(skyTextures, vec3(texCoords, layer)).rgb, fade);
+        vec3 result = (ambient + diffuse + specular) * sky;
+        FragColor = vec4(result, 1.0);
+    }
+)";
+
+// Cube Vertices (Position + Normal + TexCoords), 4 unique vertices per face
 float cubeVertices[] = {
     // positions          // normals           // texture coords
     -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
      0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 0.0f,
      0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
-     0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
     -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
 
     -0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 0.0f,
      0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 0.0f,
      0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 1.0f,
-     0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 1.0f,
     -0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 1.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 0.0f,
 
     -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
     -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
     -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
     -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
-    -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
 
      0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
      0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
      0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-     0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
      0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
-     0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
 
     -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
      0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f,
      0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
-     0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
     -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
 
     -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f,
      0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f,
      0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
-     0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
-    -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f
+    -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f
+};
+
+// Two triangles per face, same winding as the old 36-vertex list
+unsigned short cubeIndices[] = {
+     0,  1,  2,   2,  3,  0,
+     4,  5,  6,   6,  7,  4,
+     8,  9, 10,  10, 11,  8,
+    12, 13, 14,  14, 15, 12,
+    16, 17, 18,  18, 19, 16,
+    20, 21, 22,  22, 23, 20
 };
 
 // Global State
 bool gameOver = false;
 bool gameStarted = false;
 int score = 0;
-unsigned int whiteTexture;
-std::vector<unsigned int> bgTextures;
+unsigned int skyTextureArray; // every background as one layer of a GL_TEXTURE_2D_ARRAY
+int skyLayerCount = 0;
 int currentBgIndex = 0;
+int previousBgIndex = 0;       // layer being faded out
+float bgChangeTime = -100.0f;  // when currentBgIndex last changed
+const float BG_FADE_TIME = 1.0f;
+
+// Pipe, white and font pixels share one atlas; rects are (u, v, width, height) in atlas UV space
+unsigned int atlasTexture;
+glm::vec4 pipeRect;
+glm::vec4 whiteRect;
+glm::vec4 fontRect;
+bool showStats = false; // F3 toggles the render stats overlay
 
 struct Bird {
     glm::vec3 position;
     float velocity;
     float size;
     float rotation;
+    float flapTime; // seconds since the last jump, picks the bird's animation clip
 
-    Bird() : position(0.0f, 0.0f, 0.0f), velocity(0.0f), size(0.5f), rotation(0.0f) {}
+    Bird() : position(0.0f, 0.0f, 0.0f), velocity(0.0f), size(0.5f), rotation(0.0f), flapTime(10.0f) {}
 
     void reset() {
         position = glm::vec3(0.0f, 0.0f, 0.0f);
         velocity = 0.0f;
         rotation = 0.0f;
+        flapTime = 10.0f;
     }
 
     void update(float dt) {
+        flapTime += dt;
         velocity += GRAVITY * dt;
         position.y += velocity * dt;
         
@@ -186,6 +338,7 @@ struct Bird {
     void jump() {
         velocity = JUMP_FORCE;
         rotation = 30.0f;
+        flapTime = 0.0f;
     }
 };
 
@@ -217,13 +370,168 @@ unsigned int compileShader(unsigned int type, const char* source) {
     return id;
 }
 
-unsigned int createShaderProgram() {
-    unsigned int vertex = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
-    unsigned int fragment = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+// Program Binary Cache
+// Linked programs are kept in one file as glGetProgramBinary blobs, keyed by a
+// hash of their sources. The file starts with the driver's vendor, renderer and
+// version strings; any difference discards the whole cache, and a blob the
+// driver refuses just falls back to compiling. Needs ARB_get_program_binary,
+// which glad (GL 3.3) doesn't load, so its entry points are fetched here.
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC_)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC_)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC_)(GLuint program, GLenum pname, GLint value);
+PFNGLGETPROGRAMBINARYPROC_ glGetProgramBinaryPtr = NULL;
+PFNGLPROGRAMBINARYPROC_ glProgramBinaryPtr = NULL;
+PFNGLPROGRAMPARAMETERIPROC_ glProgramParameteriPtr = NULL;
+
+const char* PROGRAM_CACHE_PATH = "shader_cache.bin";
+const unsigned int PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCache {
+    struct Entry {
+        unsigned int format;
+        std::vector<char> binary;
+    };
+    bool supported = false;
+    bool loaded = false;
+    bool dirty = false;
+    std::string driver;
+    std::unordered_map<unsigned long long, Entry> entries;
+    int compiled = 0, fromCache = 0;
+    double seconds = 0.0; // spent creating programs
+
+    // Called right after glad with the same loader
+    void init(GLADloadproc load) {
+        glGetProgramBinaryPtr = (PFNGLGETPROGRAMBINARYPROC_)load("glGetProgramBinary");
+        glProgramBinaryPtr = (PFNGLPROGRAMBINARYPROC_)load("glProgramBinary");
+        glProgramParameteriPtr = (PFNGLPROGRAMPARAMETERIPROC_)load("glProgramParameteri");
+        bool extension = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1);
+        int extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (int i = 0; i < extensionCount && !extension; i++) {
+            extension = strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_get_program_binary") == 0;
+        }
+        int formats = 0;
+        if (extension) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = extension && formats > 0 && glGetProgramBinaryPtr && glProgramBinaryPtr && glProgramParameteriPtr;
+        driver = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+    }
+
+    static unsigned long long hashSources(const char* vertexSource, const char* fragmentSource) {
+        unsigned long long hash = 14695981039346656037ull; // FNV-1a
+        for (const char* source : {vertexSource, fragmentSource}) {
+            for (const char* c = source; *c; c++) hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+            hash = (hash ^ 0xff) * 1099511628211ull; // separator, so moving text between stages changes the key
+        }
+        return hash;
+    }
+
+    void load() {
+        loaded = true;
+        std::ifstream file(PROGRAM_CACHE_PATH, std::ios::binary);
+        if (!file) return;
+        unsigned int version = 0, driverLength = 0, count = 0;
+        file.read((char*)&version, 4);
+        file.read((char*)&driverLength, 4);
+        if (!file || version != PROGRAM_CACHE_VERSION || driverLength > 4096) return;
+        std::string fileDriver(driverLength, '\0');
+        file.read(&fileDriver[0], driverLength);
+        if (fileDriver != driver) {
+            std::cout << "Program cache was built by another driver, recompiling" << std::endl;
+            dirty = true;
+            return;
+        }
+        file.read((char*)&count, 4);
+        for (unsigned int i = 0; i < count && file; i++) {
+            unsigned long long hash = 0;
+            unsigned int length = 0;
+            Entry entry;
+            file.read((char*)&hash, 8);
+            file.read((char*)&entry.format, 4);
+            file.read((char*)&length, 4);
+            if (!file || length > (64u << 20)) break;
+            entry.binary.resize(length);
+            file.read(entry.binary.data(), length);
+            if (file) entries[hash] = std::move(entry);
+        }
+    }
+
+    void save() {
+        if (!supported || !dirty) return;
+        std::ofstream file(PROGRAM_CACHE_PATH, std::ios::binary);
+        if (!file) {
+            std::cout << "Failed to write program cache: " << PROGRAM_CACHE_PATH << std::endl;
+            return;
+        }
+        unsigned int version = PROGRAM_CACHE_VERSION, driverLength = (unsigned int)driver.size(), count = (unsigned int)entries.size();
+        file.write((const char*)&version, 4);
+        file.write((const char*)&driverLength, 4);
+        file.write(driver.data(), driverLength);
+        file.write((const char*)&count, 4);
+        for (const auto& item : entries) {
+            unsigned int length = (unsigned int)item.second.binary.size();
+            file.write((const char*)&item.first, 8);
+            file.write((const char*)&item.second.format, 4);
+            file.write((const char*)&length, 4);
+            file.write(item.second.binary.data(), length);
+        }
+        dirty = false;
+    }
+
+    // Linked program from the cache, or 0 if it's missing or the driver rejects it
+    unsigned int find(unsigned long long hash) {
+        if (!supported) return 0;
+        if (!loaded) load();
+        auto it = entries.find(hash);
+        if (it == entries.end()) return 0;
+        unsigned int id = glCreateProgram();
+        glProgramBinaryPtr(id, it->second.format, it->second.binary.data(), (GLsizei)it->second.binary.size());
+        int success = 0;
+        glGetProgramiv(id, GL_LINK_STATUS, &success);
+        if (!success) {
+            glDeleteProgram(id);
+            entries.erase(it);
+            dirty = true;
+            return 0;
+        }
+        return id;
+    }
+
+    void store(unsigned long long hash, unsigned int program) {
+        if (!supported) return;
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+        Entry entry;
+        entry.binary.resize(length);
+        glGetProgramBinaryPtr(program, length, NULL, &entry.format, entry.binary.data());
+        entries[hash] = std::move(entry);
+        dirty = true;
+    }
+};
+
+ProgramCache programCache;
+
+// Linked program for the pair of sources, from the binary cache when possible
+unsigned int createShaderProgram(const char* vertexSource, const char* fragmentSource) {
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long hash = ProgramCache::hashSources(vertexSource, fragmentSource);
+    unsigned int id = programCache.find(hash);
+    if (id) {
+        programCache.fromCache++;
+        programCache.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return id;
+    }
+
+    unsigned int vertex = compileShader(GL_VERTEX_SHADER, vertexSource);
+    unsigned int fragment = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
     
-    unsigned int id = glCreateProgram();
+    id = glCreateProgram();
     glAttachShader(id, vertex);
     glAttachShader(id, fragment);
+    if (programCache.supported) glProgramParameteriPtr(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(id);
     
     int success;
@@ -232,87 +540,455 @@ unsigned int createShaderProgram() {
     if (!success) {
         glGetProgramInfoLog(id, 512, NULL, infoLog);
         std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    } else {
+        programCache.store(hash, id);
     }
     
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+    programCache.compiled++;
+    programCache.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
     return id;
 }
 
-// Texture loading helper
-unsigned int loadTexture(char const * path)
-{
+// GL State Cache
+// Shadow copy of the bindings and fixed-function state set every frame, so
+// setting a value that is already current costs no GL call. All per-frame
+// code sets state through glState and sets everything it depends on, instead
+// of restoring defaults for whoever comes next. One-off code (loading,
+// --obs-check, teardown) calls GL directly; invalidate() afterwards makes
+// the next set of each value go through again. Only texture unit 0 is used.
+const unsigned int GL_STATE_UNKNOWN = 0xFFFFFFFFu;
+const int GL_STATE_UNIFORM_BLOCKS = 2; // palette and materials
+
+struct GLStateCache {
+    unsigned int program;
+    unsigned int vertexArray;
+    unsigned int framebuffer;
+    unsigned int texture2D;
+    unsigned int textureArray;
+    unsigned int arrayBuffer;
+    unsigned int uniformBuffer;
+    unsigned int packBuffer;
+    unsigned int uniformBlocks[GL_STATE_UNIFORM_BLOCKS];
+    int viewportRect[4];
+    unsigned int depthTest;  // GL_TRUE, GL_FALSE or GL_STATE_UNKNOWN, as are blend and depthWrite
+    unsigned int blend;
+    unsigned int depthWrite;
+    unsigned int depthCompare;
+    unsigned int blendSource;
+    unsigned int blendDestination;
+    glm::vec4 clearRGBA;
+    int skipped = 0;     // calls saved so far this frame
+    int lastSkipped = 0; // in the previous frame, for the overlay
+
+    GLStateCache() { invalidate(); }
+
+    void invalidate() {
+        program = vertexArray = framebuffer = GL_STATE_UNKNOWN;
+        texture2D = textureArray = GL_STATE_UNKNOWN;
+        arrayBuffer = uniformBuffer = packBuffer = GL_STATE_UNKNOWN;
+        for (unsigned int& block : uniformBlocks) block = GL_STATE_UNKNOWN;
+        viewportRect[0] = viewportRect[1] = viewportRect[2] = viewportRect[3] = -1;
+        depthTest = blend = depthWrite = depthCompare = blendSource = blendDestination = GL_STATE_UNKNOWN;
+        clearRGBA = glm::vec4(-1.0f);
+    }
+
+    void endFrame() {
+        lastSkipped = skipped;
+        skipped = 0;
+    }
+
+    // Records a new value, or counts a skipped call when it is already set
+    bool change(unsigned int& current, unsigned int value) {
+        if (current == value) {
+            skipped++;
+            return false;
+        }
+        current = value;
+        return true;
+    }
+
+    bool useProgram(unsigned int id) {
+        if (!change(program, id)) return false;
+        glUseProgram(id);
+        return true;
+    }
+
+    bool bindVertexArray(unsigned int id) {
+        if (!change(vertexArray, id)) return false;
+        glBindVertexArray(id);
+        return true;
+    }
+
+    bool bindTexture(GLenum target, unsigned int id) {
+        if (!change(target == GL_TEXTURE_2D_ARRAY ? textureArray : texture2D, id)) return false;
+        glBindTexture(target, id);
+        return true;
+    }
+
+    // The element array binding belongs to the bound VAO, so it is never cached
+    void bindBuffer(GLenum target, unsigned int id) {
+        unsigned int* current = target == GL_ARRAY_BUFFER ? &arrayBuffer : target == GL_UNIFORM_BUFFER ? &uniformBuffer :
+                                target == GL_PIXEL_PACK_BUFFER ? &packBuffer : NULL;
+        if (current && !change(*current, id)) return;
+        glBindBuffer(target, id);
+    }
+
+    // Also binds the generic GL_UNIFORM_BUFFER point, as glBindBufferBase does
+    void bindUniformBlock(unsigned int index, unsigned int id) {
+        if (index < (unsigned int)GL_STATE_UNIFORM_BLOCKS && !change(uniformBlocks[index], id)) return;
+        glBindBufferBase(GL_UNIFORM_BUFFER, index, id);
+        uniformBuffer = id;
+    }
+
+    void bindFramebuffer(unsigned int id) {
+        if (change(framebuffer, id)) glBindFramebuffer(GL_FRAMEBUFFER, id);
+    }
+
+    // Asks the driver only when something outside the cache bound it last
+    unsigned int boundFramebuffer() {
+        if (framebuffer == GL_STATE_UNKNOWN) {
+            int id = 0;
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &id);
+            framebuffer = id;
+        }
+        return framebuffer;
+    }
+
+    void viewport(int x, int y, int width, int height) {
+        if (viewportRect[0] == x && viewportRect[1] == y && viewportRect[2] == width && viewportRect[3] == height) {
+            skipped++;
+            return;
+        }
+        viewportRect[0] = x;
+        viewportRect[1] = y;
+        viewportRect[2] = width;
+        viewportRect[3] = height;
+        glViewport(x, y, width, height);
+    }
+
+    void setDepthTest(bool enabled) {
+        if (!change(depthTest, enabled ? GL_TRUE : GL_FALSE)) return;
+        if (enabled) glEnable(GL_DEPTH_TEST);
+        else glDisable(GL_DEPTH_TEST);
+    }
+
+    void setBlend(bool enabled) {
+        if (!change(blend, enabled ? GL_TRUE : GL_FALSE)) return;
+        if (enabled) glEnable(GL_BLEND);
+        else glDisable(GL_BLEND);
+    }
+
+    void depthMask(bool write) {
+        if (change(depthWrite, write ? GL_TRUE : GL_FALSE)) glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void depthFunc(GLenum func) {
+        if (change(depthCompare, func)) glDepthFunc(func);
+    }
+
+    void clearColor(const glm::vec4& color) {
+        if (clearRGBA == color) {
+            skipped++;
+            return;
+        }
+        clearRGBA = color;
+        glClearColor(color.r, color.g, color.b, color.a);
+    }
+
+    void blendFunc(GLenum source, GLenum destination) {
+        if (blendSource == source && blendDestination == destination) {
+            skipped++;
+            return;
+        }
+        blendSource = source;
+        blendDestination = destination;
+        glBlendFunc(source, destination);
+    }
+};
+
+GLStateCache glState;
+
+// Bilinear resize of an RGBA image
+std::vector<unsigned char> resizeImage(const unsigned char* data, int width, int height, int newWidth, int newHeight) {
+    std::vector<unsigned char> result(newWidth * newHeight * 4);
+    for (int y = 0; y < newHeight; y++) {
+        float sy = glm::clamp((y + 0.5f) * height / newHeight - 0.5f, 0.0f, (float)(height - 1));
+        int y0 = (int)sy;
+        int y1 = glm::min(y0 + 1, height - 1);
+        float fy = sy - y0;
+        for (int x = 0; x < newWidth; x++) {
+            float sx = glm::clamp((x + 0.5f) * width / newWidth - 0.5f, 0.0f, (float)(width - 1));
+            int x0 = (int)sx;
+            int x1 = glm::min(x0 + 1, width - 1);
+            float fx = sx - x0;
+            for (int c = 0; c < 4; c++) {
+                float top = glm::mix((float)data[(y0 * width + x0) * 4 + c], (float)data[(y0 * width + x1) * 4 + c], fx);
+                float bottom = glm::mix((float)data[(y1 * width + x0) * 4 + c], (float)data[(y1 * width + x1) * 4 + c], fx);
+                result[(y * newWidth + x) * 4 + c] = (unsigned char)(glm::mix(top, bottom, fy) + 0.5f);
+            }
+        }
+    }
+    return result;
+}
+
+// Loads every image as one layer of a GL_TEXTURE_2D_ARRAY, resized to the largest image's resolution
+unsigned int loadTextureArray(const std::vector<std::string>& paths, int& layerCount) {
+    struct Image {
+        unsigned char* data;
+        int width, height;
+    };
+    std::vector<Image> images;
+    int width = 1, height = 1;
+    for (const auto& path : paths) {
+        Image image;
+        int nrComponents;
+        image.data = stbi_load(path.c_str(), &image.width, &image.height, &nrComponents, 4);
+        if (!image.data) {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            continue;
+        }
+        width = glm::max(width, image.width);
+        height = glm::max(height, image.height);
+        images.push_back(image);
+    }
+
     unsigned int textureID;
     glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    layerCount = glm::max((int)images.size(), 1);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    for (int layer = 0; layer < (int)images.size(); layer++) {
+        const Image& image = images[layer];
+        if (image.width == width && image.height == height) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.data);
+        } else {
+            std::vector<unsigned char> resized = resizeImage(image.data, image.width, image.height, width, height);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, resized.data());
+        }
+        stbi_image_free(image.data);
+    }
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
 
+// Loads a standalone mipmapped RGBA texture; 0 if the file can't be read
+unsigned int loadTexture(const std::string& path) {
     int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrComponents, 4);
+    if (!data) {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        return 0;
+    }
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    stbi_image_free(data);
+    return textureID;
+}
+
+// Shelf-packed RGBA atlas. Every entry gets its edge pixels extruded into a
+// padding border so bilinear filtering and the first mip levels don't bleed.
+struct TextureAtlas {
+    static const int PADDING = 4;
+    int width, height;
+    int cursorX = 0, cursorY = 0, rowHeight = 0;
+    std::vector<unsigned char> pixels;
+
+    TextureAtlas(int w, int h) : width(w), height(h), pixels(w * h * 4, 0) {}
 
+    // Returns the entry's UV rect (u, v, width, height), or an empty rect if it doesn't fit
+    glm::vec4 add(const unsigned char* data, int w, int h, int channels) {
+        int paddedW = w + PADDING * 2;
+        int paddedH = h + PADDING * 2;
+        if (cursorX + paddedW > width) {
+            cursorX = 0;
+            cursorY += rowHeight;
+            rowHeight = 0;
+        }
+        if (cursorX + paddedW > width || cursorY + paddedH > height) {
+            std::cout << "Texture atlas is full" << std::endl;
+            return glm::vec4(0.0f);
+        }
+
+        for (int y = -PADDING; y < h + PADDING; y++) {
+            int sy = glm::clamp(y, 0, h - 1);
+            for (int x = -PADDING; x < w + PADDING; x++) {
+                int sx = glm::clamp(x, 0, w - 1);
+                const unsigned char* src = &data[(sy * w + sx) * channels];
+                unsigned char* dst = &pixels[((cursorY + PADDING + y) * width + cursorX + PADDING + x) * 4];
+                for (int c = 0; c < 4; c++) {
+                    // Single-channel sources (font coverage) are replicated into every channel
+                    dst[c] = (channels == 1) ? src[0] : (c < channels ? src[c] : 255);
+                }
+            }
+        }
+
+        glm::vec4 rect((float)(cursorX + PADDING) / width, (float)(cursorY + PADDING) / height, (float)w / width, (float)h / height);
+        cursorX += paddedW;
+        rowHeight = glm::max(rowHeight, paddedH);
+        return rect;
+    }
+
+    unsigned int upload() {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 2); // padding covers two mip levels
         glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return textureID;
+    }
+};
+
+// Simulation Clock
+// The game advances in fixed ticks, so a seed plus the tick-stamped input
+// events reproduce a run exactly. Everything time-based reads simTime rather
+// than the wall clock, which lets replays render faster than real time.
+const int SIM_TICK_RATE = 60;
+const float SIM_DT = 1.0f / SIM_TICK_RATE;
+
+enum SimEventType {
+    EVENT_FLAP,           // space or the start button: starts the game if needed and jumps
+    EVENT_RESTART,        // R after game over: back to the start screen
+    EVENT_RESTART_PLAYING // restart button: straight into a new run
+};
+
+struct SimEvent {
+    unsigned int tick;
+    SimEventType type;
+};
+
+float simTime = 0.0f;
+unsigned int simTick = 0;
+bool replaying = false;              // live input is ignored while a replay drives the sim
+std::vector<SimEvent> queuedEvents;  // input waiting for the next tick
+std::vector<SimEvent> recordedEvents;
+
+void queueSimEvent(SimEventType type) {
+    if (!replaying) queuedEvents.push_back({0, type});
+}
+
+// Switches the background layer and starts a cross-fade from the old one
+void setBackground(int index) {
+    previousBgIndex = currentBgIndex;
+    currentBgIndex = index;
+    bgChangeTime = simTime;
+}
+
+// Input
+// Gameplay input arrives through GLFW callbacks, stamped with glfwGetTime(),
+// and waits in a lock-free single-producer/single-consumer ring until the sim
+// drains it at tick granularity. A tap shorter than a frame still registers,
+// and lands on the tick it happened in rather than whenever the loop polled.
+enum InputType { INPUT_FLAP, INPUT_RESTART, INPUT_CLICK };
+
+struct InputEvent {
+    double time;
+    InputType type;
+    float x, y; // cursor position for clicks
+};
+
+const unsigned int INPUT_QUEUE_SIZE = 256; // power of two
 
-        stbi_image_free(data);
+struct InputQueue {
+    InputEvent events[INPUT_QUEUE_SIZE];
+    std::atomic<unsigned int> head{0}; // written by the producer (callbacks)
+    std::atomic<unsigned int> tail{0}; // written by the consumer (sim)
+
+    bool push(const InputEvent& event) {
+        unsigned int h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE) return false; // full, drop
+        events[h & (INPUT_QUEUE_SIZE - 1)] = event;
+        head.store(h + 1, std::memory_order_release);
+        return true;
     }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+
+    const InputEvent* peek() {
+        unsigned int t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return NULL;
+        return &events[t & (INPUT_QUEUE_SIZE - 1)];
     }
 
-    return textureID;
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+InputQueue inputQueue;
+
+void keyCallback(GLFWwindow*, int key, int, int action, int) {
+    if (action != GLFW_PRESS) return;
+    if (key == GLFW_KEY_SPACE) inputQueue.push({glfwGetTime(), INPUT_FLAP, 0.0f, 0.0f});
+    else if (key == GLFW_KEY_R) inputQueue.push({glfwGetTime(), INPUT_RESTART, 0.0f, 0.0f});
 }
 
-// Input callback
-Bird bird;
-void processInput(GLFWwindow *window) {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) return;
+    double mx, my;
+    glfwGetCursorPos(window, &mx, &my);
+    inputQueue.push({glfwGetTime(), INPUT_CLICK, (float)mx, (float)my});
+}
 
-    // R key for restart
-    if (gameOver && glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
-        gameOver = false;
-        gameStarted = false;
-        bird.reset();
-        score = 0;
-        pipes.clear();
-        
-        // Change background randomly
-        static std::uniform_int_distribution<int> bgDist(0, 100);
-        if (!bgTextures.empty()) {
-            currentBgIndex = bgDist(rng) % bgTextures.size();
-        }
+// Time from a flap input to the return of the swap that first shows it, over the last samples
+const int LATENCY_SAMPLES = 64;
 
-        for (int i = 0; i < 5; i++) {
-            pipes.emplace_back(PIPE_SPAWN_X + i * PIPE_DISTANCE, dist(rng));
-        }
+struct InputLatency {
+    double pendingInput = -1.0; // oldest flap not yet presented
+    float samples[LATENCY_SAMPLES] = {};
+    int sampleCount = 0;
+    float last = 0.0f, average = 0.0f, worst = 0.0f;
+
+    void inputApplied(double inputTime) {
+        if (pendingInput < 0.0) pendingInput = inputTime;
     }
 
-    static bool spacePressed = false;
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
-        if (!spacePressed) {
-            if (!gameOver) {
-                if (!gameStarted) gameStarted = true;
-                bird.jump();
-            }
-            spacePressed = true;
+    void presented(double now) {
+        if (pendingInput < 0.0) return;
+        last = (float)(now - pendingInput);
+        pendingInput = -1.0;
+        samples[sampleCount++ % LATENCY_SAMPLES] = last;
+        int n = glm::min(sampleCount, LATENCY_SAMPLES);
+        average = 0.0f;
+        worst = 0.0f;
+        for (int i = 0; i < n; i++) {
+            average += samples[i] / n;
+            worst = glm::max(worst, samples[i]);
         }
+    }
+};
+
+InputLatency inputLatency;
+
+// Polled keys that don't affect the simulation
+Bird bird;
+void processInput(GLFWwindow *window) {
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
+
+    static bool statsKeyPressed = false;
+    if (glfwGetKey(window, GLFW_KEY_F3) == GLFW_PRESS) {
+        if (!statsKeyPressed) showStats = !showStats;
+        statsKeyPressed = true;
     } else {
-        spacePressed = false;
+        statsKeyPressed = false;
     }
 }
 
@@ -341,299 +1017,5364 @@ bool checkCollision(const Bird& b, const Pipe& p) {
     return false;
 }
 
-struct GLTFMesh {
-    unsigned int VAO;
-    int indexCount;
-    int indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
-    glm::vec4 color;
-};
-
-std::vector<GLTFMesh> loadBirdModel(std::string path) {
-    std::vector<GLTFMesh> meshes;
-    
-    std::ifstream f(path);
-    if (!f) {
-        std::cout << "Failed to load GLTF: " << path << std::endl;
-        return meshes;
-    }
-    json j;
-    f >> j;
+// Particles
+// Feather bursts on flaps and debris on crashes. Particles live in a fixed
+// pool stored as structure of arrays, allocated once, and dead ones are
+// swap-removed so the live range stays dense. Integration is 8 particles at a
+// time with AVX2 when the CPU has it (picked at runtime, so the build needs no
+// -mavx2), 4 with SSE otherwise. The live range of each stream is uploaded to
+// its own slice of one buffer and drawn as a single instanced draw.
+const int PARTICLE_CAPACITY = 131072;
+const float PARTICLE_GRAVITY = -9.0f;
+const float PARTICLE_DRAG = 0.6f; // fraction of horizontal speed lost per second
+const int FEATHERS_PER_FLAP = 24;
+const int DEBRIS_PER_CRASH = 400;
 
-    std::string binPath = path.substr(0, path.find_last_of("/\\")) + "/bird.bin";
-    std::ifstream binFile(binPath, std::ios::binary);
-    if (!binFile) {
-        std::cout << "Failed to load binary: " << binPath << std::endl;
-        return meshes;
-    }
-    std::vector<unsigned char> binData((std::istreambuf_iterator<char>(binFile)), std::istreambuf_iterator<char>());
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PARTICLES_AVX2 1
+#endif
 
-    for (const auto& mesh : j["meshes"]) {
-        if (mesh.contains("name")) {
-            std::string name = mesh["name"];
-            if (name == "Cube.001") continue;
-        }
-        for (const auto& primitive : mesh["primitives"]) {
-            GLTFMesh gltfMesh;
-            
-            // Material
-            if (primitive.contains("material")) {
-                int matIdx = primitive["material"];
-                auto& mat = j["materials"][matIdx];
-                auto& colorFactor = mat["pbrMetallicRoughness"]["baseColorFactor"];
-                gltfMesh.color = glm::vec4(colorFactor[0], colorFactor[1], colorFactor[2], colorFactor[3]);
-            } else {
-                gltfMesh.color = glm::vec4(1.0f);
-            }
+enum ParticleStream { STREAM_X, STREAM_Y, STREAM_Z, STREAM_LIFE, STREAM_LIFETIME, STREAM_SIZE, STREAM_COLOR, PARTICLE_STREAMS };
 
-            // Indices
-            int indicesIdx = primitive["indices"];
-            auto& indicesAccessor = j["accessors"][indicesIdx];
-            int indicesBufferViewIdx = indicesAccessor["bufferView"];
-            auto& indicesBufferView = j["bufferViews"][indicesBufferViewIdx];
-            int indicesOffset = (indicesAccessor.contains("byteOffset") ? (int)indicesAccessor["byteOffset"] : 0) + (int)indicesBufferView["byteOffset"];
-            gltfMesh.indexCount = indicesAccessor["count"];
-            int componentType = indicesAccessor["componentType"];
-            gltfMesh.indexType = (componentType == 5123) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+// Camera-facing quads from gl_VertexID, one instance per particle, shrinking as they die
+const char* particleVertexShaderSource = R"(
+    #version 330 core
+    layout (location = 0) in float aX;
+    layout (location = 1) in float aY;
+    layout (location = 2) in float aZ;
+    layout (location = 3) in float aLife;
+    layout (location = 4) in float aLifetime;
+    layout (location = 5) in float aSize;
+    layout (location = 6) in vec4 aColor;
 
-            // Attributes
-            int posIdx = primitive["attributes"]["POSITION"];
-            auto& posAccessor = j["accessors"][posIdx];
-            int posBufferViewIdx = posAccessor["bufferView"];
-            auto& posBufferView = j["bufferViews"][posBufferViewIdx];
-            int posOffset = (posAccessor.contains("byteOffset") ? (int)posAccessor["byteOffset"] : 0) + (int)posBufferView["byteOffset"];
-            
-            int normIdx = primitive["attributes"]["NORMAL"];
-            auto& normAccessor = j["accessors"][normIdx];
-            int normBufferViewIdx = normAccessor["bufferView"];
-            auto& normBufferView = j["bufferViews"][normBufferViewIdx];
-            int normOffset = (normAccessor.contains("byteOffset") ? (int)normAccessor["byteOffset"] : 0) + (int)normBufferView["byteOffset"];
-
-            glGenVertexArrays(1, &gltfMesh.VAO);
-            glBindVertexArray(gltfMesh.VAO);
-
-            unsigned int posVBO;
-            glGenBuffers(1, &posVBO);
-            glBindBuffer(GL_ARRAY_BUFFER, posVBO);
-            int posCount = posAccessor["count"];
-            glBufferData(GL_ARRAY_BUFFER, posCount * 12, &binData[posOffset], GL_STATIC_DRAW);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-            glEnableVertexAttribArray(0);
-
-            unsigned int normVBO;
-            glGenBuffers(1, &normVBO);
-            glBindBuffer(GL_ARRAY_BUFFER, normVBO);
-            int normCount = normAccessor["count"];
-            glBufferData(GL_ARRAY_BUFFER, normCount * 12, &binData[normOffset], GL_STATIC_DRAW);
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-            glEnableVertexAttribArray(1);
-
-            unsigned int EBO;
-            glGenBuffers(1, &EBO);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            int indexSize = (gltfMesh.indexType == GL_UNSIGNED_SHORT) ? 2 : 4;
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, gltfMesh.indexCount * indexSize, &binData[indicesOffset], GL_STATIC_DRAW);
-
-            meshes.push_back(gltfMesh);
-        }
-    }
-    return meshes;
-}
+    out vec2 Corner;
+    out vec3 Color;
 
-// Text Shader
-const char* textVertexShaderSource = R"(
-    #version 330 core
-    layout (location = 0) in vec4 vertex; // <vec2 pos, vec2 tex>
-    out vec2 TexCoords;
+    uniform mat4 view;
     uniform mat4 projection;
-    void main() {
-        gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
-        TexCoords = vertex.zw;
+
+    void main()
+    {
+        Corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+        Color = aColor.rgb;
+        float radius = aSize * (0.3 + 0.7 * clamp(aLife / aLifetime, 0.0, 1.0));
+        vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+        vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+        vec3 world = vec3(aX, aY, aZ) + (right * Corner.x + up * Corner.y) * radius;
+        gl_Position = projection * view * vec4(world, 1.0);
     }
 )";
 
-const char* textFragmentShaderSource = R"(
+const char* particleFragmentShaderSource = R"(
     #version 330 core
-    in vec2 TexCoords;
-    out vec4 color;
-    uniform sampler2D text;
-    uniform vec4 textColor;
-    void main() {
-        vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
-        color = textColor * sampled;
+    out vec4 FragColor;
+    in vec2 Corner;
+    in vec3 Color;
+
+    void main()
+    {
+        if (dot(Corner, Corner) > 1.0) discard; // round, and opaque so no sorting is needed
+        FragColor = vec4(Color, 1.0);
     }
 )";
 
-stbtt_bakedchar cdata[96]; 
-unsigned int fontTexture;
-unsigned int textVAO, textVBO;
-unsigned int textShaderProgram;
+struct ParticleSystem {
+    int count = 0;
+    std::vector<float> x, y, z, vx, vy, vz, life, lifetime, size;
+    std::vector<unsigned int> color; // RGBA8
+    std::mt19937 gen{7};             // separate from the game's rng so effects never change the course
+    bool useAvx2 = false;
+    unsigned int VAO = 0, VBO = 0, program = 0;
 
-void initTextRenderer(const char* fontPath) {
-    // Compile shader
-    unsigned int vertex = compileShader(GL_VERTEX_SHADER, textVertexShaderSource);
-    unsigned int fragment = compileShader(GL_FRAGMENT_SHADER, textFragmentShaderSource);
-    textShaderProgram = glCreateProgram();
-    glAttachShader(textShaderProgram, vertex);
-    glAttachShader(textShaderProgram, fragment);
-    glLinkProgram(textShaderProgram);
-    
-    // Load font
+    void init() {
+        for (std::vector<float>* stream : {&x, &y, &z, &vx, &vy, &vz, &life, &lifetime, &size}) stream->assign(PARTICLE_CAPACITY, 0.0f);
+        color.assign(PARTICLE_CAPACITY, 0);
+#ifdef PARTICLES_AVX2
+        useAvx2 = __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    void emit(glm::vec3 position, glm::vec3 baseVelocity, int amount, float speed, float minLife, float maxLife, float minSize, float maxSize, glm::vec3 colorA, glm::vec3 colorB) {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int n = 0; n < amount && count < PARTICLE_CAPACITY; n++) {
+            int i = count++;
+            float angle = unit(gen) * 6.2831853f;
+            float elevation = unit(gen) * 2.0f - 1.0f;
+            float horizontal = sqrtf(1.0f - elevation * elevation);
+            float s = speed * (0.3f + 0.7f * unit(gen));
+            x[i] = position.x;
+            y[i] = position.y;
+            z[i] = position.z;
+            vx[i] = cosf(angle) * horizontal * s + baseVelocity.x;
+            vy[i] = elevation * s + baseVelocity.y;
+            vz[i] = sinf(angle) * horizontal * s + baseVelocity.z;
+            lifetime[i] = life[i] = glm::mix(minLife, maxLife, unit(gen));
+            size[i] = glm::mix(minSize, maxSize, unit(gen));
+            glm::vec3 c = glm::mix(colorA, colorB, unit(gen)) * 255.0f;
+            color[i] = (unsigned int)c.r | ((unsigned int)c.g << 8) | ((unsigned int)c.b << 16) | (255u << 24);
+        }
+    }
+
+    // Feathers trail behind with the scrolling world
+    void emitFeathers(glm::vec3 position) {
+        emit(position, glm::vec3(-BIRD_SPEED, -1.0f, 0.0f), FEATHERS_PER_FLAP, 2.0f, 0.4f, 0.9f, 0.05f, 0.09f, glm::vec3(1.0f), glm::vec3(1.0f, 0.85f, 0.4f));
+    }
+
+    void emitDebris(glm::vec3 position) {
+        emit(position, glm::vec3(0.0f, 2.0f, 0.0f), DEBRIS_PER_CRASH, 6.0f, 0.8f, 1.6f, 0.04f, 0.1f, glm::vec3(0.9f, 0.15f, 0.1f), glm::vec3(0.35f, 0.2f, 0.1f));
+    }
+
+    void integrateScalar(int begin, float dt) {
+        float drag = 1.0f - PARTICLE_DRAG * dt;
+        for (int i = begin; i < count; i++) {
+            vx[i] *= drag;
+            vz[i] *= drag;
+            vy[i] += PARTICLE_GRAVITY * dt;
+            x[i] += vx[i] * dt;
+            y[i] += vy[i] * dt;
+            z[i] += vz[i] * dt;
+            life[i] -= dt;
+        }
+    }
+
+    int integrateSse(float dt) {
+        int i = 0;
+#if defined(__SSE__) || defined(_M_X64)
+        __m128 step = _mm_set1_ps(dt), drag = _mm_set1_ps(1.0f - PARTICLE_DRAG * dt), fall = _mm_set1_ps(PARTICLE_GRAVITY * dt);
+        for (; i + 4 <= count; i += 4) {
+            __m128 velX = _mm_mul_ps(_mm_loadu_ps(&vx[i]), drag);
+            __m128 velY = _mm_add_ps(_mm_loadu_ps(&vy[i]), fall);
+            __m128 velZ = _mm_mul_ps(_mm_loadu_ps(&vz[i]), drag);
+            _mm_storeu_ps(&vx[i], velX);
+            _mm_storeu_ps(&vy[i], velY);
+            _mm_storeu_ps(&vz[i], velZ);
+            _mm_storeu_ps(&x[i], _mm_add_ps(_mm_loadu_ps(&x[i]), _mm_mul_ps(velX, step)));
+            _mm_storeu_ps(&y[i], _mm_add_ps(_mm_loadu_ps(&y[i]), _mm_mul_ps(velY, step)));
+            _mm_storeu_ps(&z[i], _mm_add_ps(_mm_loadu_ps(&z[i]), _mm_mul_ps(velZ, step)));
+            _mm_storeu_ps(&life[i], _mm_sub_ps(_mm_loadu_ps(&life[i]), step));
+        }
+#endif
+        return i;
+    }
+
+#ifdef PARTICLES_AVX2
+    __attribute__((target("avx2,fma"))) int integrateAvx2(float dt) {
+        int i = 0;
+        __m256 step = _mm256_set1_ps(dt), drag = _mm256_set1_ps(1.0f - PARTICLE_DRAG * dt), fall = _mm256_set1_ps(PARTICLE_GRAVITY * dt);
+        for (; i + 8 <= count; i += 8) {
+            __m256 velX = _mm256_mul_ps(_mm256_loadu_ps(&vx[i]), drag);
+            __m256 velY = _mm256_add_ps(_mm256_loadu_ps(&vy[i]), fall);
+            __m256 velZ = _mm256_mul_ps(_mm256_loadu_ps(&vz[i]), drag);
+            _mm256_storeu_ps(&vx[i], velX);
+            _mm256_storeu_ps(&vy[i], velY);
+            _mm256_storeu_ps(&vz[i], velZ);
+            _mm256_storeu_ps(&x[i], _mm256_fmadd_ps(velX, step, _mm256_loadu_ps(&x[i])));
+            _mm256_storeu_ps(&y[i], _mm256_fmadd_ps(velY, step, _mm256_loadu_ps(&y[i])));
+            _mm256_storeu_ps(&z[i], _mm256_fmadd_ps(velZ, step, _mm256_loadu_ps(&z[i])));
+            _mm256_storeu_ps(&life[i], _mm256_sub_ps(_mm256_loadu_ps(&life[i]), step));
+        }
+        return i;
+    }
+#endif
+
+    void update(float dt) {
+        int done = 0;
+#ifdef PARTICLES_AVX2
+        if (useAvx2) done = integrateAvx2(dt);
+        else
+#endif
+        done = integrateSse(dt);
+        integrateScalar(done, dt);
+
+        // Swap-remove the dead; order doesn't matter for opaque billboards
+        for (int i = 0; i < count;) {
+            if (life[i] > 0.0f) {
+                i++;
+                continue;
+            }
+            int last = --count;
+            x[i] = x[last]; y[i] = y[last]; z[i] = z[last];
+            vx[i] = vx[last]; vy[i] = vy[last]; vz[i] = vz[last];
+            life[i] = life[last]; lifetime[i] = lifetime[last]; size[i] = size[last]; color[i] = color[last];
+        }
+    }
+
+    void initGL() {
+        program = createShaderProgram(particleVertexShaderSource, particleFragmentShaderSource);
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, (size_t)PARTICLE_STREAMS * PARTICLE_CAPACITY * 4, NULL, GL_STREAM_DRAW);
+        // Every stream has a fixed slice of the buffer, so the SoA arrays upload as they are
+        for (int stream = 0; stream < PARTICLE_STREAMS; stream++) {
+            size_t offset = (size_t)stream * PARTICLE_CAPACITY * 4;
+            glEnableVertexAttribArray(stream);
+            if (stream == STREAM_COLOR) glVertexAttribPointer(stream, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4, (void*)offset);
+            else glVertexAttribPointer(stream, 1, GL_FLOAT, GL_FALSE, 4, (void*)offset);
+            glVertexAttribDivisor(stream, 1);
+        }
+        glBindVertexArray(0);
+    }
+
+    void upload() {
+        if (count == 0) return;
+        glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, (size_t)PARTICLE_STREAMS * PARTICLE_CAPACITY * 4, NULL, GL_STREAM_DRAW); // orphan
+        const void* streams[PARTICLE_STREAMS] = {x.data(), y.data(), z.data(), life.data(), lifetime.data(), size.data(), color.data()};
+        for (int stream = 0; stream < PARTICLE_STREAMS; stream++) {
+            glBufferSubData(GL_ARRAY_BUFFER, (size_t)stream * PARTICLE_CAPACITY * 4, (size_t)count * 4, streams[stream]);
+        }
+    }
+
+    void destroy() {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteProgram(program);
+    }
+};
+
+ParticleSystem particles;
+
+// --particle-bench: CPU cost of one update with the pool at 100k live particles
+void runParticleBenchmark() {
+    ParticleSystem bench;
+    bench.init();
+    bool avx2 = bench.useAvx2;
+    for (int pass = 0; pass < (avx2 ? 2 : 1); pass++) {
+        bench.useAvx2 = avx2 && pass == 0;
+        const int rounds = 200;
+        double seconds = 0.0;
+        for (int r = 0; r < rounds; r++) {
+            // Refill to 100k every round, excluding the refill from the timing
+            bench.count = 0;
+            bench.emit(glm::vec3(0.0f), glm::vec3(0.0f), 100000, 5.0f, 1.0f, 2.0f, 0.05f, 0.1f, glm::vec3(1.0f), glm::vec3(0.5f));
+            for (int i = 0; i < bench.count; i += 97) bench.life[i] = 0.001f; // ~1% die this step
+            auto start = std::chrono::steady_clock::now();
+            bench.update(SIM_DT);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        std::cout << "Particles (" << (bench.useAvx2 ? "AVX2" : "SSE") << "): 100000 live, " << seconds * 1000.0 / rounds
+                  << " ms per update, " << bench.count << " left after the last step" << std::endl;
+    }
+}
+
+void restartGame(bool playing) {
+    gameOver = false;
+    gameStarted = playing;
+    bird.reset();
+    score = 0;
+    pipes.clear();
+
+    // Change background randomly
+    static std::uniform_int_distribution<int> bgDist(0, 100);
+    setBackground(bgDist(rng) % skyLayerCount);
+
+    for (int i = 0; i < 5; i++) {
+        pipes.emplace_back(PIPE_SPAWN_X + i * PIPE_DISTANCE, dist(rng));
+    }
+}
+
+// Events are checked against the state at the tick they apply to, so a
+// late restart or a flap after death is a no-op in both live play and replay
+void applySimEvent(SimEventType type) {
+    if (type == EVENT_FLAP && !gameOver) {
+        if (!gameStarted) gameStarted = true;
+        bird.jump();
+        particles.emitFeathers(bird.position);
+    } else if (type == EVENT_RESTART && gameOver) {
+        restartGame(false);
+    } else if (type == EVENT_RESTART_PLAYING && gameOver) {
+        restartGame(true);
+    }
+}
+
+float cameraY = 0.0f;
+float lastBgChangeTime = 0.0f;
+
+// One fixed step of game logic
+void stepSimulation() {
+    for (const SimEvent& event : queuedEvents) {
+        recordedEvents.push_back({simTick, event.type});
+        applySimEvent(event.type);
+    }
+    queuedEvents.clear();
+
+    // Auto-change background every 10 seconds
+    if (simTime - lastBgChangeTime >= 10.0f) {
+        setBackground((currentBgIndex + 1) % skyLayerCount);
+        lastBgChangeTime = simTime;
+    }
+
+    // Update Game Logic
+    if (gameStarted && !gameOver) {
+        bird.update(SIM_DT);
+
+        // Move pipes
+        for (auto& pipe : pipes) {
+            pipe.x -= BIRD_SPEED * SIM_DT;
+        }
+
+        // Recycle pipes
+        if (pipes.front().x < -10.0f) {
+            pipes.erase(pipes.begin());
+            float lastX = pipes.back().x;
+            pipes.emplace_back(lastX + PIPE_DISTANCE, dist(rng));
+        }
+
+        // Score
+        for (auto& pipe : pipes) {
+            if (!pipe.passed && pipe.x < bird.position.x) {
+                score++;
+                pipe.passed = true;
+            }
+        }
+
+        // Collision
+        for (const auto& pipe : pipes) {
+            if (checkCollision(bird, pipe)) {
+                gameOver = true;
+            }
+        }
+
+        // Ground/Ceiling collision
+        if (bird.position.y < -5.0f || bird.position.y > 5.0f) {
+            gameOver = true;
+        }
+        if (gameOver) particles.emitDebris(bird.position);
+    }
+    particles.update(SIM_DT);
+
+    // Camera follows the bird (Smooth Follow), clamped so it doesn't go too wild
+    float targetY = glm::clamp(bird.position.y, -3.0f, 3.0f);
+    cameraY = glm::mix(cameraY, targetY, 2.0f * SIM_DT); // Smooth lerp
+
+    simTick++;
+    simTime = simTick * SIM_DT;
+}
+
+// Replay File
+// Text file: the RNG seed, the tick rate it was recorded at, one line per
+// input event and the tick the run ended on. Pipe gaps come from the standard
+// library's distributions, so replays are exact on builds with the same one.
+struct Replay {
+    unsigned int seed = 0;
+    unsigned int endTick = 0;
+    std::vector<SimEvent> events;
+
+    bool save(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file) {
+            std::cout << "Failed to write replay: " << path << std::endl;
+            return false;
+        }
+        file << "flappy-replay 1\nseed " << seed << "\ntick_rate " << SIM_TICK_RATE << "\n";
+        const char* names[] = { "flap", "restart", "restart_playing" };
+        for (const SimEvent& event : events) file << names[event.type] << " " << event.tick << "\n";
+        file << "end " << endTick << "\n";
+        return true;
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream file(path);
+        std::string word;
+        int version = 0;
+        if (!file || !(file >> word >> version) || word != "flappy-replay") {
+            std::cout << "Failed to load replay: " << path << std::endl;
+            return false;
+        }
+        unsigned int value;
+        while (file >> word >> value) {
+            if (word == "seed") seed = value;
+            else if (word == "tick_rate" && (int)value != SIM_TICK_RATE) std::cout << "Replay was recorded at " << value << " ticks/s, playing at " << SIM_TICK_RATE << std::endl;
+            else if (word == "flap") events.push_back({value, EVENT_FLAP});
+            else if (word == "restart") events.push_back({value, EVENT_RESTART});
+            else if (word == "restart_playing") events.push_back({value, EVENT_RESTART_PLAYING});
+            else if (word == "end") endTick = value;
+        }
+        return true;
+    }
+};
+
+// Bind-pose copy of a skinned model for skinning on the CPU (software renderers)
+struct CpuSkin {
+    std::vector<glm::vec4> positions; // w = 1
+    std::vector<glm::vec4> normals;   // w = 0
+    std::vector<unsigned char> joints; // 4 palette slots per vertex
+    std::vector<glm::vec4> weights;
+    std::vector<glm::vec4> output;    // skinned position, normal pairs; uploaded each frame
+    unsigned int VAO = 0;             // positions/normals from VBO, the rest from the model buffer
+    unsigned int VBO = 0;
+};
+
+// One level of detail: a range of the element buffer over the submesh's vertices
+struct MeshLod {
+    int indexOffset; // bytes into the element buffer
+    int indexCount;
+    float error;     // bind-pose geometric error in model units
+};
+
+struct GLTFMesh {
+    unsigned int VAO;
+    unsigned int VBO;
+    unsigned int EBO;
+    int indexCount;
+    int indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+};
+
+const int MAX_MATERIALS = 16;
+
+// One primitive of a merged model: its slice of the shared buffers
+struct SubMesh {
+    int baseVertex;
+    int vertexCount;
+    int material;              // slot in the model's material block
+    float boundsRadius;        // bind-pose radius around the model origin
+    glm::vec3 boundsMin;       // bind-pose AABB from the POSITION accessor
+    glm::vec3 boundsMax;
+    std::vector<MeshLod> lods; // finest first
+};
+
+// All primitives of a GLTF model in one interleaved vertex buffer and one
+// index buffer, drawn with a single glMultiDrawElementsBaseVertex
+struct GLTFModel {
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+    unsigned int materialUBO = 0;
+    int indexType = GL_UNSIGNED_SHORT;
+    bool skinned = false;
+    std::vector<SubMesh> subMeshes;
+    std::vector<glm::vec4> materials; // slot 0 is white
+    std::vector<std::string> materialImages; // per slot, empty when untextured
+    CpuSkin cpuSkin;
+
+    // Multi-draw arguments for the LODs picked this frame
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+    std::vector<GLint> drawBaseVertices;
+};
+
+// Compact vertex (16 bytes instead of 32): half-float position,
+// 10:10:10:2 packed normal and 16-bit normalized texture coordinates.
+struct CompactVertex {
+    unsigned short position[4]; // xyz as half floats, w is padding
+    unsigned int normal;         // GL_INT_2_10_10_10_REV
+    unsigned short texCoord[2];  // GL_UNSIGNED_SHORT, normalized
+};
+
+CompactVertex packVertex(glm::vec3 position, glm::vec3 normal, glm::vec2 texCoord) {
+    CompactVertex v;
+    v.position[0] = glm::packHalf1x16(position.x);
+    v.position[1] = glm::packHalf1x16(position.y);
+    v.position[2] = glm::packHalf1x16(position.z);
+    v.position[3] = glm::packHalf1x16(1.0f);
+    v.normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+    v.texCoord[0] = glm::packUnorm1x16(texCoord.x);
+    v.texCoord[1] = glm::packUnorm1x16(texCoord.y);
+    return v;
+}
+
+// Uploads an indexed compact mesh and sets up attributes 0-2 to match the scene shader
+GLTFMesh createCompactMesh(const std::vector<CompactVertex>& vertices, const void* indices, int indexCount, int indexType) {
+    GLTFMesh mesh;
+    mesh.indexCount = indexCount;
+    mesh.indexType = indexType;
+
+    glGenVertexArrays(1, &mesh.VAO);
+    glBindVertexArray(mesh.VAO);
+
+    glGenBuffers(1, &mesh.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(CompactVertex), vertices.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoord));
+    glEnableVertexAttribArray(2);
+
+    glGenBuffers(1, &mesh.EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+    int indexSize = (indexType == GL_UNSIGNED_SHORT) ? 2 : 4;
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    return mesh;
+}
+
+GLTFMesh createCubeMesh() {
+    std::vector<CompactVertex> vertices;
+    for (int i = 0; i < 24; i++) {
+        const float* v = &cubeVertices[i * 8];
+        vertices.push_back(packVertex(glm::vec3(v[0], v[1], v[2]), glm::vec3(v[3], v[4], v[5]), glm::vec2(v[6], v[7])));
+    }
+    return createCompactMesh(vertices, cubeIndices, 36, GL_UNSIGNED_SHORT);
+}
+
+void destroyMesh(GLTFMesh& mesh) {
+    glDeleteVertexArrays(1, &mesh.VAO);
+    glDeleteBuffers(1, &mesh.VBO);
+    glDeleteBuffers(1, &mesh.EBO);
+}
+
+// Mesh Compression
+// EXT_meshopt_compression streams. Vertex attributes are split into byte
+// planes, delta and zigzag coded per vertex, and packed in groups of 16 at 0,
+// 2, 4 or 8 bits with escapes for outliers. Triangle lists are coded against a
+// 16-entry edge FIFO and vertex FIFO, mostly one byte per triangle. The
+// encoders serve the asset cooker; the loader uses the decoders, which unpack
+// byte groups with SSSE3 shuffles when the CPU has them.
+const int MESHOPT_VERTEX_HEADER = 0xa0; // version 0
+const int MESHOPT_INDEX_HEADER = 0xe1;  // version 1
+const int MESHOPT_GROUP = 16;
+const int MESHOPT_BLOCK_BYTES = 8192;
+const int MESHOPT_BLOCK_MAX = 256;
+const int MESHOPT_TAIL = 32;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MESHOPT_SSSE3 1
+#endif
+
+// Vertices per block: the block's byte planes must fit the 8 KB scratch buffer
+int meshoptBlockSize(int vertexSize) {
+    int result = (MESHOPT_BLOCK_BYTES / vertexSize) & ~(MESHOPT_GROUP - 1);
+    return result < MESHOPT_BLOCK_MAX ? result : MESHOPT_BLOCK_MAX;
+}
+
+unsigned char zigzag8(unsigned char v) {
+    return (unsigned char)(((signed char)v >> 7) ^ (v << 1));
+}
+
+unsigned char unzigzag8(unsigned char v) {
+    return (unsigned char)(-(v & 1) ^ (v >> 1));
+}
+
+// Group modes in a 2-bit header per group: 0 all zero, 1 two bits, 2 four bits,
+// 3 raw bytes. Packed values at the sentinel (all ones) are escaped to a full
+// byte following the packed part.
+void encodeByteGroups(std::vector<unsigned char>& out, const unsigned char* buffer, int size) {
+    size_t header = out.size();
+    out.resize(out.size() + (size / MESHOPT_GROUP + 3) / 4, 0);
+    for (int g = 0; g < size; g += MESHOPT_GROUP) {
+        const unsigned char* group = buffer + g;
+        bool zero = true;
+        for (int i = 0; i < MESHOPT_GROUP; i++) zero = zero && group[i] == 0;
+        int mode = zero ? 0 : 3;
+        int bestSize = MESHOPT_GROUP;
+        for (int m = 1; m <= 2 && !zero; m++) {
+            int bits = 1 << m;
+            int packedSize = MESHOPT_GROUP * bits / 8;
+            for (int i = 0; i < MESHOPT_GROUP; i++) packedSize += group[i] >= (1 << bits) - 1;
+            if (packedSize < bestSize) {
+                bestSize = packedSize;
+                mode = m;
+            }
+        }
+        out[header + g / (MESHOPT_GROUP * 4)] |= (unsigned char)(mode << ((g / MESHOPT_GROUP % 4) * 2));
+
+        if (mode == 3) {
+            out.insert(out.end(), group, group + MESHOPT_GROUP);
+        } else if (mode != 0) {
+            int bits = 1 << mode;
+            unsigned char sentinel = (unsigned char)((1 << bits) - 1);
+            for (int i = 0; i < MESHOPT_GROUP; i += 8 / bits) {
+                unsigned char byte = 0;
+                for (int k = 0; k < 8 / bits; k++) byte = (unsigned char)((byte << bits) | glm::min(group[i + k], sentinel));
+                out.push_back(byte);
+            }
+            for (int i = 0; i < MESHOPT_GROUP; i++) {
+                if (group[i] >= sentinel) out.push_back(group[i]);
+            }
+        }
+    }
+}
+
+std::vector<unsigned char> encodeVertexBuffer(const unsigned char* vertices, int count, int vertexSize) {
+    std::vector<unsigned char> out;
+    out.push_back(MESHOPT_VERTEX_HEADER);
+    unsigned char first[256] = {}, last[256] = {};
+    if (count > 0) memcpy(first, vertices, vertexSize);
+    memcpy(last, first, vertexSize);
+
+    int blockSize = meshoptBlockSize(vertexSize);
+    unsigned char buffer[MESHOPT_BLOCK_MAX];
+    for (int offset = 0; offset < count; offset += blockSize) {
+        int n = glm::min(blockSize, count - offset);
+        int aligned = (n + MESHOPT_GROUP - 1) & ~(MESHOPT_GROUP - 1);
+        const unsigned char* block = vertices + (size_t)offset * vertexSize;
+        for (int k = 0; k < vertexSize; k++) {
+            memset(buffer, 0, aligned);
+            unsigned char p = last[k];
+            for (int i = 0; i < n; i++) {
+                unsigned char v = block[i * vertexSize + k];
+                buffer[i] = zigzag8((unsigned char)(v - p));
+                p = v;
+            }
+            encodeByteGroups(out, buffer, aligned);
+        }
+        memcpy(last, block + (n - 1) * vertexSize, vertexSize);
+    }
+
+    // The first vertex seeds the deltas; stored last, padded so the decoder can over-read
+    if (vertexSize < MESHOPT_TAIL) out.resize(out.size() + MESHOPT_TAIL - vertexSize, 0);
+    out.insert(out.end(), first, first + vertexSize);
+    return out;
+}
+
+const unsigned char* decodeByteGroup(const unsigned char* data, unsigned char* out, int mode) {
+    if (mode == 0) {
+        memset(out, 0, MESHOPT_GROUP);
+        return data;
+    }
+    if (mode == 3) {
+        memcpy(out, data, MESHOPT_GROUP);
+        return data + MESHOPT_GROUP;
+    }
+    int bits = 1 << mode;
+    int sentinel = (1 << bits) - 1;
+    const unsigned char* escapes = data + MESHOPT_GROUP * bits / 8;
+    for (int i = 0; i < MESHOPT_GROUP; i++) {
+        int v = (data[i * bits / 8] >> (8 - bits - (i * bits) % 8)) & sentinel;
+        out[i] = (v == sentinel) ? *escapes++ : (unsigned char)v;
+    }
+    return escapes;
+}
+
+#ifdef MESHOPT_SSSE3
+// For each 8-bit mask of escaped lanes: where each lane's escape byte sits
+// (0x80 zeroes the lane in pshufb) and how many escapes the half consumes
+struct ByteGroupShuffles {
+    unsigned char shuffle[256][8];
+    unsigned char count[256];
+
+    ByteGroupShuffles() {
+        for (int mask = 0; mask < 256; mask++) {
+            int next = 0;
+            for (int i = 0; i < 8; i++) shuffle[mask][i] = (mask & (1 << i)) ? (unsigned char)next++ : 0x80;
+            count[mask] = (unsigned char)next;
+        }
+    }
+};
+
+const ByteGroupShuffles byteGroupShuffles;
+
+// 2- and 4-bit groups: spread the packed fields to one byte per lane, then
+// pull escaped lanes from the bytes that follow with a single shuffle
+__attribute__((target("ssse3"))) const unsigned char* decodeByteGroupSsse3(const unsigned char* data, unsigned char* out, int mode) {
+    if (mode != 1 && mode != 2) return decodeByteGroup(data, out, mode);
+
+    int packedSize = (mode == 1) ? 4 : 8;
+    __m128i selectors;
+    if (mode == 1) {
+        int packed;
+        memcpy(&packed, data, 4);
+        __m128i sel2 = _mm_cvtsi32_si128(packed);
+        __m128i sel22 = _mm_unpacklo_epi8(_mm_srli_epi16(sel2, 4), sel2);
+        __m128i sel2222 = _mm_unpacklo_epi8(_mm_srli_epi16(sel22, 2), sel22);
+        selectors = _mm_and_si128(sel2222, _mm_set1_epi8(3));
+    } else {
+        __m128i sel4 = _mm_loadl_epi64((const __m128i*)data);
+        __m128i sel44 = _mm_unpacklo_epi8(_mm_srli_epi16(sel4, 4), sel4);
+        selectors = _mm_and_si128(sel44, _mm_set1_epi8(15));
+    }
+    __m128i sentinel = _mm_set1_epi8(mode == 1 ? 3 : 15);
+    __m128i escaped = _mm_cmpeq_epi8(selectors, sentinel);
+    int mask = _mm_movemask_epi8(escaped);
+    int mask0 = mask & 255, mask1 = mask >> 8;
+
+    __m128i shuffle0 = _mm_loadl_epi64((const __m128i*)byteGroupShuffles.shuffle[mask0]);
+    __m128i shuffle1 = _mm_add_epi8(_mm_loadl_epi64((const __m128i*)byteGroupShuffles.shuffle[mask1]), _mm_set1_epi8(byteGroupShuffles.count[mask0]));
+    __m128i rest = _mm_loadu_si128((const __m128i*)(data + packedSize));
+    __m128i result = _mm_or_si128(_mm_shuffle_epi8(rest, _mm_unpacklo_epi64(shuffle0, shuffle1)), _mm_andnot_si128(escaped, selectors));
+    _mm_storeu_si128((__m128i*)out, result);
+    return data + packedSize + byteGroupShuffles.count[mask0] + byteGroupShuffles.count[mask1];
+}
+#endif
+
+// Returns the read position after 'size' bytes of groups, or nullptr if the stream is short
+const unsigned char* decodeByteGroups(const unsigned char* data, const unsigned char* end, unsigned char* out, int size, bool simd) {
+    int headerSize = (size / MESHOPT_GROUP + 3) / 4;
+    if (end - data < headerSize) return nullptr;
+    const unsigned char* header = data;
+    data += headerSize;
+    for (int g = 0; g < size; g += MESHOPT_GROUP) {
+        int mode = (header[g / (MESHOPT_GROUP * 4)] >> ((g / MESHOPT_GROUP % 4) * 2)) & 3;
+        // Worst case a group reads 8 packed bytes and 16 escapes (the SIMD path loads them all)
+        if (end - data < 24) {
+            int need = (mode == 0) ? 0 : (mode == 3) ? MESHOPT_GROUP : MESHOPT_GROUP * (1 << mode) / 8;
+            if (end - data < need) return nullptr;
+            if (mode == 1 || mode == 2) {
+                int bits = 1 << mode;
+                for (int i = 0; i < MESHOPT_GROUP; i++) need += ((data[i * bits / 8] >> (8 - bits - (i * bits) % 8)) & ((1 << bits) - 1)) == (1 << bits) - 1;
+                if (end - data < need) return nullptr;
+            }
+            data = decodeByteGroup(data, out + g, mode);
+            continue;
+        }
+#ifdef MESHOPT_SSSE3
+        if (simd) {
+            data = decodeByteGroupSsse3(data, out + g, mode);
+            continue;
+        }
+#endif
+        data = decodeByteGroup(data, out + g, mode);
+    }
+    return data;
+}
+
+// Undoes the zigzag deltas of one byte plane: a prefix sum over 16 lanes at a time
+void decodeDeltas(const unsigned char* deltas, int count, unsigned char& last, unsigned char* out, int stride) {
+    int i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; i + MESHOPT_GROUP <= count; i += MESHOPT_GROUP) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(deltas + i));
+        __m128i odd = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi8(1)));
+        __m128i half = _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(127));
+        v = _mm_xor_si128(odd, half);
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi8(v, _mm_set1_epi8((char)last));
+        unsigned char lanes[MESHOPT_GROUP];
+        _mm_storeu_si128((__m128i*)lanes, v);
+        for (int k = 0; k < MESHOPT_GROUP; k++) out[(i + k) * stride] = lanes[k];
+        last = lanes[MESHOPT_GROUP - 1];
+    }
+#endif
+    for (; i < count; i++) {
+        last = (unsigned char)(last + unzigzag8(deltas[i]));
+        out[i * stride] = last;
+    }
+}
+
+bool decodeVertexBuffer(unsigned char* vertices, int count, int vertexSize, const unsigned char* data, size_t size) {
+    if (vertexSize <= 0 || vertexSize > 256 || vertexSize % 4 != 0) return false;
+    if (size < 1 + (size_t)glm::max(vertexSize, MESHOPT_TAIL) || data[0] != MESHOPT_VERTEX_HEADER) return false;
+    const unsigned char* end = data + size;
+    unsigned char last[256];
+    memcpy(last, end - vertexSize, vertexSize);
+    data++;
+
+#ifdef MESHOPT_SSSE3
+    static const bool simd = __builtin_cpu_supports("ssse3");
+#else
+    const bool simd = false;
+#endif
+    int blockSize = meshoptBlockSize(vertexSize);
+    unsigned char buffer[MESHOPT_BLOCK_MAX];
+    for (int offset = 0; offset < count; offset += blockSize) {
+        int n = glm::min(blockSize, count - offset);
+        int aligned = (n + MESHOPT_GROUP - 1) & ~(MESHOPT_GROUP - 1);
+        unsigned char* block = vertices + (size_t)offset * vertexSize;
+        for (int k = 0; k < vertexSize; k++) {
+            data = decodeByteGroups(data, end, buffer, aligned, simd);
+            if (!data) return false;
+            decodeDeltas(buffer, n, last[k], block + k, vertexSize);
+        }
+    }
+    return end - data == glm::max(vertexSize, MESHOPT_TAIL);
+}
+
+// Free indices are zigzag deltas from the previous free index, in 7-bit groups
+void encodeIndexDelta(std::vector<unsigned char>& out, unsigned int index, unsigned int& last) {
+    unsigned int d = index - last;
+    unsigned int v = (d << 1) ^ (unsigned int)((int)d >> 31);
+    do {
+        out.push_back((unsigned char)((v & 127) | (v > 127 ? 128 : 0)));
+        v >>= 7;
+    } while (v);
+    last = index;
+}
+
+unsigned int decodeIndexDelta(const unsigned char*& data, const unsigned char* end, unsigned int& last) {
+    unsigned int v = 0;
+    for (int shift = 0; shift < 35 && data < end; shift += 7) {
+        unsigned char byte = *data++;
+        v |= (unsigned int)(byte & 127) << shift;
+        if (!(byte & 128)) break;
+    }
+    last += (v >> 1) ^ (unsigned int)(-(int)(v & 1));
+    return last;
+}
+
+// Pairs of vertex FIFO codes (b, c) common enough for a one-byte triangle
+const unsigned char MESHOPT_CODEAUX[16] = {0x00, 0x76, 0x87, 0x56, 0x67, 0x78, 0xa9, 0x86, 0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00};
+
+struct TriangleFifos {
+    unsigned int edges[16][2];
+    unsigned int vertices[16];
+    unsigned int edgeOffset = 0, vertexOffset = 0;
+
+    TriangleFifos() {
+        memset(edges, -1, sizeof(edges));
+        memset(vertices, -1, sizeof(vertices));
+    }
+    void pushEdge(unsigned int a, unsigned int b) {
+        edges[edgeOffset][0] = a;
+        edges[edgeOffset][1] = b;
+        edgeOffset = (edgeOffset + 1) & 15;
+    }
+    void pushVertex(unsigned int v, bool cond = true) {
+        vertices[vertexOffset] = v;
+        vertexOffset = (vertexOffset + cond) & 15;
+    }
+    int findVertex(unsigned int v) const {
+        for (int i = 0; i < 16; i++) {
+            if (vertices[(vertexOffset - 1 - i) & 15] == v) return i;
+        }
+        return -1;
+    }
+    // Edge slot and which rotation of the triangle starts with that edge
+    int findEdge(unsigned int a, unsigned int b, unsigned int c) const {
+        for (int i = 0; i < 16; i++) {
+            const unsigned int* e = edges[(edgeOffset - 1 - i) & 15];
+            if (e[0] == a && e[1] == b) return i << 2;
+            if (e[0] == b && e[1] == c) return (i << 2) | 1;
+            if (e[0] == c && e[1] == a) return (i << 2) | 2;
+        }
+        return -1;
+    }
+};
+
+std::vector<unsigned char> encodeIndexBuffer(const unsigned int* indices, int indexCount) {
+    static const int rotations[3][3] = {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}};
+    std::vector<unsigned char> codes, data;
+    codes.push_back(MESHOPT_INDEX_HEADER);
+    TriangleFifos fifo;
+    unsigned int next = 0, last = 0;
+
+    for (int i = 0; i + 2 < indexCount; i += 3) {
+        const unsigned int* tri = indices + i;
+        int edge = fifo.findEdge(tri[0], tri[1], tri[2]);
+        if (edge >= 0 && (edge >> 2) < 15) {
+            // Shares an edge with a recent triangle: one code for the edge and the third vertex
+            const int* order = rotations[edge & 3];
+            unsigned int a = tri[order[0]], b = tri[order[1]], c = tri[order[2]];
+            int fc = fifo.findVertex(c);
+            int fec = (fc >= 1 && fc < 13) ? fc : (c == next) ? (next++, 0) : 15;
+            if (fec == 15 && c + 1 == last) fec = 13;
+            if (fec == 15 && c == last + 1) fec = 14;
+            codes.push_back((unsigned char)(((edge >> 2) << 4) | fec));
+            if (fec == 15) encodeIndexDelta(data, c, last);
+            else if (fec >= 13) last = c;
+            if (fec == 0 || fec >= 13) fifo.pushVertex(c);
+            fifo.pushEdge(c, b);
+            fifo.pushEdge(a, c);
+        } else {
+            int rotation = (tri[1] == next) ? 1 : (tri[2] == next) ? 2 : 0;
+            const int* order = rotations[rotation];
+            unsigned int a = tri[order[0]], b = tri[order[1]], c = tri[order[2]];
+            bool reset = a == 0 && b == 1 && c == 2 && next > 0;
+            if (reset) {
+                next = 0;
+                memset(fifo.vertices, -1, sizeof(fifo.vertices));
+            }
+            int fb = fifo.findVertex(b), fc = fifo.findVertex(c);
+            int fea = (a == next) ? (next++, 0) : 15;
+            int feb = (fb >= 0 && fb < 14) ? fb + 1 : (b == next) ? (next++, 0) : 15;
+            int fec = (fc >= 0 && fc < 14) ? fc + 1 : (c == next) ? (next++, 0) : 15;
+            unsigned char codeaux = (unsigned char)((feb << 4) | fec);
+            int table = -1;
+            for (int t = 0; t < 14 && table < 0; t++) {
+                if (MESHOPT_CODEAUX[t] == codeaux) table = t;
+            }
+            if (fea == 0 && table >= 0 && !reset) {
+                codes.push_back((unsigned char)(0xf0 | table));
+            } else {
+                codes.push_back((unsigned char)(fea == 0 ? 0xfe : 0xff));
+                data.push_back(codeaux);
+            }
+            if (fea == 15) encodeIndexDelta(data, a, last);
+            if (feb == 15) encodeIndexDelta(data, b, last);
+            if (fec == 15) encodeIndexDelta(data, c, last);
+            fifo.pushVertex(a);
+            if (feb == 0 || feb == 15) fifo.pushVertex(b);
+            if (fec == 0 || fec == 15) fifo.pushVertex(c);
+            fifo.pushEdge(b, a);
+            fifo.pushEdge(c, b);
+            fifo.pushEdge(a, c);
+        }
+    }
+    codes.insert(codes.end(), data.begin(), data.end());
+    codes.insert(codes.end(), MESHOPT_CODEAUX, MESHOPT_CODEAUX + 16);
+    return codes;
+}
+
+// The codec may rotate a triangle's indices; winding is kept, so that's the same triangle
+bool sameTriangles(const unsigned int* a, const unsigned int* b, int indexCount) {
+    for (int i = 0; i < indexCount; i += 3) {
+        bool same = false;
+        for (int r = 0; r < 3 && !same; r++) {
+            same = a[i] == b[i + r] && a[i + 1] == b[i + (r + 1) % 3] && a[i + 2] == b[i + (r + 2) % 3];
+        }
+        if (!same) return false;
+    }
+    return true;
+}
+
+bool decodeIndexBuffer(unsigned int* indices, int indexCount, const unsigned char* buffer, size_t size) {
+    if (indexCount % 3 != 0 || size < 1 + (size_t)indexCount / 3 + 16 || buffer[0] != MESHOPT_INDEX_HEADER) return false;
+    TriangleFifos fifo;
+    unsigned int next = 0, last = 0;
+    const unsigned char* code = buffer + 1;
+    const unsigned char* data = code + indexCount / 3;
+    const unsigned char* dataEnd = buffer + size - 16;
+    const unsigned char* codeauxTable = dataEnd;
+
+    for (int i = 0; i < indexCount; i += 3) {
+        if (data > dataEnd) return false;
+        unsigned char codetri = *code++;
+        unsigned int a, b, c;
+        if (codetri < 0xf0) {
+            const unsigned int* edge = fifo.edges[(fifo.edgeOffset - 1 - (codetri >> 4)) & 15];
+            a = edge[0];
+            b = edge[1];
+            int fec = codetri & 15;
+            if (fec < 13) {
+                c = (fec == 0) ? next++ : fifo.vertices[(fifo.vertexOffset - 1 - fec) & 15];
+                fifo.pushVertex(c, fec == 0);
+            } else {
+                // 13 and 14 step the last free index down or up by one
+                c = (fec == 15) ? decodeIndexDelta(data, dataEnd, last) : (last += (fec == 13) ? -1 : 1);
+                fifo.pushVertex(c);
+            }
+            fifo.pushEdge(c, b);
+            fifo.pushEdge(a, c);
+        } else {
+            unsigned char codeaux;
+            int fea;
+            if (codetri < 0xfe) {
+                codeaux = codeauxTable[codetri & 15];
+                fea = 0;
+            } else {
+                codeaux = *data++;
+                fea = (codetri == 0xfe) ? 0 : 15;
+                if (codeaux == 0) next = 0; // reset
+            }
+            int feb = codeaux >> 4, fec = codeaux & 15;
+            a = (fea == 0) ? next++ : 0;
+            b = (feb == 0) ? next++ : fifo.vertices[(fifo.vertexOffset - feb) & 15];
+            c = (fec == 0) ? next++ : fifo.vertices[(fifo.vertexOffset - fec) & 15];
+            if (fea == 15) a = decodeIndexDelta(data, dataEnd, last);
+            if (feb == 15) b = decodeIndexDelta(data, dataEnd, last);
+            if (fec == 15) c = decodeIndexDelta(data, dataEnd, last);
+            fifo.pushVertex(a);
+            fifo.pushVertex(b, feb == 0 || feb == 15);
+            fifo.pushVertex(c, fec == 0 || fec == 15);
+            fifo.pushEdge(b, a);
+            fifo.pushEdge(c, b);
+            fifo.pushEdge(a, c);
+        }
+        indices[i] = a;
+        indices[i + 1] = b;
+        indices[i + 2] = c;
+    }
+    return data == dataEnd;
+}
+
+// GLTF buffer and image URIs are percent-encoded ("Flappy%20Pipe.bin")
+std::string urlDecode(const std::string& uri) {
+    std::string result;
+    for (size_t i = 0; i < uri.size(); i++) {
+        if (uri[i] == '%' && i + 2 < uri.size()) {
+            result += (char)strtol(uri.substr(i + 1, 2).c_str(), NULL, 16);
+            i += 2;
+        } else {
+            result += uri[i];
+        }
+    }
+    return result;
+}
+
+// Reads the start of an accessor's data inside the binary buffer
+int accessorOffset(const json& j, const json& accessor) {
+    int bufferViewIdx = accessor["bufferView"];
+    auto& bufferView = j["bufferViews"][bufferViewIdx];
+    int viewOffset = bufferView.contains("byteOffset") ? (int)bufferView["byteOffset"] : 0;
+    return (accessor.contains("byteOffset") ? (int)accessor["byteOffset"] : 0) + viewOffset;
+}
+
+int readAccessorInt(const std::vector<unsigned char>& bin, int offset, int componentType, int components, int i, int c) {
+    if (componentType == 5121) return bin[offset + i * components + c];
+    if (componentType == 5125) {
+        unsigned int v;
+        memcpy(&v, &bin[offset + (i * components + c) * 4], 4);
+        return (int)v;
+    }
+    unsigned short v;
+    memcpy(&v, &bin[offset + (i * components + c) * 2], 2);
+    return v;
+}
+
+int componentSize(int componentType) {
+    if (componentType == 5120 || componentType == 5121) return 1;
+    if (componentType == 5122 || componentType == 5123) return 2;
+    return 4;
+}
+
+int typeComponents(const std::string& type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "MAT4") return 16;
+    return 4; // VEC4, MAT2
+}
+
+// Strided, typed view of an accessor. KHR_mesh_quantization attributes are
+// 8/16-bit integers (normalized or not) padded to 4-byte elements.
+struct AccessorReader {
+    const unsigned char* data = nullptr;
+    int stride = 0;
+    int componentType = 5126;
+    bool normalized = false;
+
+    float read(int i, int c) const {
+        const unsigned char* p = data + (size_t)i * stride;
+        if (componentType == 5120) {
+            signed char v = (signed char)p[c];
+            return normalized ? glm::max(v / 127.0f, -1.0f) : v;
+        }
+        if (componentType == 5121) return normalized ? p[c] / 255.0f : p[c];
+        if (componentType == 5122) {
+            short v;
+            memcpy(&v, p + c * 2, 2);
+            return normalized ? glm::max(v / 32767.0f, -1.0f) : v;
+        }
+        if (componentType == 5123) {
+            unsigned short v;
+            memcpy(&v, p + c * 2, 2);
+            return normalized ? v / 65535.0f : v;
+        }
+        if (componentType == 5125) {
+            unsigned int v;
+            memcpy(&v, p + c * 4, 4);
+            return (float)v;
+        }
+        float v;
+        memcpy(&v, p + c * 4, 4);
+        return v;
+    }
+};
+
+AccessorReader accessorReader(const json& j, const std::vector<unsigned char>& bin, const json& accessor) {
+    AccessorReader reader;
+    reader.componentType = accessor["componentType"];
+    reader.normalized = accessor.value("normalized", false);
+    const json& view = j["bufferViews"][(int)accessor["bufferView"]];
+    reader.stride = view.contains("byteStride") ? (int)view["byteStride"] : componentSize(reader.componentType) * typeComponents(accessor["type"]);
+    reader.data = bin.data() + accessorOffset(j, accessor);
+    return reader;
+}
+
+// Octahedral normals: x and y are stored, z is rebuilt and the result renormalized
+void applyOctahedralFilter(unsigned char* data, int count, int stride) {
+    bool wide = stride == 8;
+    float one = wide ? 32767.0f : 127.0f;
+    for (int i = 0; i < count; i++) {
+        unsigned char* p = data + (size_t)i * stride;
+        float v[3];
+        for (int c = 0; c < 3; c++) {
+            short s = 0;
+            if (wide) memcpy(&s, p + c * 2, 2);
+            else s = (signed char)p[c];
+            v[c] = s;
+        }
+        float z = v[2] - fabsf(v[0]) - fabsf(v[1]);
+        float t = glm::min(z, 0.0f);
+        float x = v[0] + (v[0] >= 0.0f ? t : -t);
+        float y = v[1] + (v[1] >= 0.0f ? t : -t);
+        float scale = one / sqrtf(x * x + y * y + z * z);
+        float n[3] = {x * scale, y * scale, z * scale};
+        for (int c = 0; c < 3; c++) {
+            short s = (short)lroundf(n[c]);
+            if (wide) memcpy(p + c * 2, &s, 2);
+            else p[c] = (unsigned char)(signed char)s;
+        }
+    }
+}
+
+// Shared exponent floats: a 24-bit signed mantissa and an 8-bit exponent per value
+void applyExponentialFilter(unsigned char* data, int values) {
+    for (int i = 0; i < values; i++) {
+        unsigned int v;
+        memcpy(&v, data + i * 4, 4);
+        float f = ldexpf((float)((int)(v << 8) >> 8), (int)v >> 24);
+        memcpy(data + i * 4, &f, 4);
+    }
+}
+
+// Loads every buffer of a GLTF file into one byte vector and points the
+// buffer views at it, so accessors read from a single flat buffer. Views
+// compressed with EXT_meshopt_compression are decoded into their place in
+// the (otherwise empty) fallback buffer.
+bool loadGLTFBuffers(json& j, const std::string& path, std::vector<unsigned char>& bin) {
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    std::vector<size_t> base;
+    for (const auto& buffer : j["buffers"]) {
+        base.push_back(bin.size());
+        size_t length = buffer["byteLength"];
+        if (!buffer.contains("uri")) {
+            bin.resize(bin.size() + length, 0);
+        } else {
+            std::string binPath = directory + urlDecode(buffer["uri"]);
+            std::ifstream binFile(binPath, std::ios::binary);
+            if (!binFile && j["buffers"].size() == 1) {
+                // Exported buffers are often renamed after the model (bird.bin next to bird.gltf)
+                binPath = path.substr(0, path.find_last_of('.')) + ".bin";
+                binFile.open(binPath, std::ios::binary);
+            }
+            if (!binFile) {
+                std::cout << "Failed to load binary: " << binPath << std::endl;
+                return false;
+            }
+            bin.insert(bin.end(), std::istreambuf_iterator<char>(binFile), std::istreambuf_iterator<char>());
+            bin.resize(base.back() + length);
+        }
+        bin.resize((bin.size() + 3) & ~(size_t)3);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t compressedBytes = 0, decodedBytes = 0;
+    for (auto& view : j["bufferViews"]) {
+        size_t offset = base[(int)view["buffer"]] + view.value("byteOffset", (size_t)0);
+        if (view.contains("extensions") && view["extensions"].contains("EXT_meshopt_compression")) {
+            const json& ext = view["extensions"]["EXT_meshopt_compression"];
+            size_t source = base[(int)ext["buffer"]] + ext.value("byteOffset", (size_t)0);
+            size_t length = ext["byteLength"];
+            int stride = ext["byteStride"], count = ext["count"];
+            std::string mode = ext["mode"], filter = ext.value("filter", "NONE");
+            bool ok = source + length <= bin.size() && offset + (size_t)count * stride <= bin.size();
+            if (ok && mode == "ATTRIBUTES") {
+                ok = decodeVertexBuffer(&bin[offset], count, stride, &bin[source], length);
+                if (ok && filter == "OCTAHEDRAL") applyOctahedralFilter(&bin[offset], count, stride);
+                else if (ok && filter == "EXPONENTIAL") applyExponentialFilter(&bin[offset], count * stride / 4);
+                else ok = ok && filter == "NONE";
+            } else if (ok && mode == "TRIANGLES" && (stride == 2 || stride == 4)) {
+                std::vector<unsigned int> indices(count);
+                ok = decodeIndexBuffer(indices.data(), count, &bin[source], length);
+                for (int i = 0; ok && i < count; i++) {
+                    if (stride == 2) {
+                        unsigned short v = (unsigned short)indices[i];
+                        memcpy(&bin[offset + i * 2], &v, 2);
+                    } else {
+                        memcpy(&bin[offset + i * 4], &indices[i], 4);
+                    }
+                }
+            } else {
+                ok = false;
+            }
+            if (!ok) {
+                std::cout << "Failed to decode " << mode << " buffer view (filter " << filter << ") in " << path << std::endl;
+                return false;
+            }
+            compressedBytes += length;
+            decodedBytes += (size_t)count * stride;
+        }
+        view["byteOffset"] = offset;
+        view["buffer"] = 0;
+    }
+    if (decodedBytes > 0) {
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "Decoded " << compressedBytes / 1024 << " KB of compressed mesh data to " << decodedBytes / 1024 << " KB in " << ms << " ms" << std::endl;
+    }
+    return true;
+}
+
+// Scene Hierarchy
+// GLTF nodes flattened into arrays sorted depth-first, so every parent comes
+// before its children and each subtree is one contiguous range. setLocal()
+// marks a node dirty; updateWorld() then recomputes only the dirty subtrees in
+// one forward pass, with each parent's world already current when it's read.
+
+// out = a * b, column-major; out may be b
+void multiplyMat4(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+#if defined(__SSE__) || defined(_M_X64)
+    const float* pa = glm::value_ptr(a);
+    __m128 a0 = _mm_loadu_ps(pa), a1 = _mm_loadu_ps(pa + 4), a2 = _mm_loadu_ps(pa + 8), a3 = _mm_loadu_ps(pa + 12);
+    for (int c = 0; c < 4; c++) {
+        const float* column = glm::value_ptr(b) + c * 4;
+        __m128 result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(column[0])), _mm_mul_ps(a1, _mm_set1_ps(column[1]))),
+                                   _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(column[2])), _mm_mul_ps(a3, _mm_set1_ps(column[3]))));
+        _mm_storeu_ps(glm::value_ptr(out) + c * 4, result);
+    }
+#else
+    out = a * b;
+#endif
+}
+
+struct SceneHierarchy {
+    std::vector<int> parent;      // sorted index of the parent, -1 for roots
+    std::vector<int> subtreeEnd;  // one past the node's last descendant
+    std::vector<int> gltfNode;    // sorted index -> GLTF node
+    std::vector<int> sortedIndex; // GLTF node -> sorted index
+    std::vector<glm::mat4> local;
+    std::vector<glm::mat4> world;
+    std::vector<unsigned char> dirty;
+
+    void setLocal(int node, const glm::mat4& transform) {
+        local[node] = transform;
+        dirty[node] = 1;
+    }
+
+    // Returns how many nodes were recomputed
+    int updateWorld() {
+        int count = (int)parent.size(), updated = 0;
+        for (int i = 0; i < count;) {
+            if (!dirty[i]) {
+                i++;
+                continue;
+            }
+            for (int k = i; k < subtreeEnd[i]; k++) {
+                if (parent[k] >= 0) multiplyMat4(world[parent[k]], local[k], world[k]);
+                else world[k] = local[k];
+                dirty[k] = 0;
+            }
+            updated += subtreeEnd[i] - i;
+            i = subtreeEnd[i];
+        }
+        return updated;
+    }
+};
+
+glm::mat4 nodeLocalTransform(const json& node) {
+    if (node.contains("matrix")) {
+        glm::mat4 m;
+        for (int i = 0; i < 16; i++) m[i / 4][i % 4] = node["matrix"][i];
+        return m;
+    }
+    glm::vec3 t(0.0f), s(1.0f);
+    glm::quat r(1.0f, 0.0f, 0.0f, 0.0f);
+    if (node.contains("translation")) t = glm::vec3(node["translation"][0], node["translation"][1], node["translation"][2]);
+    if (node.contains("rotation")) r = glm::quat(node["rotation"][3], node["rotation"][0], node["rotation"][1], node["rotation"][2]); // GLTF stores xyzw
+    if (node.contains("scale")) s = glm::vec3(node["scale"][0], node["scale"][1], node["scale"][2]);
+    return glm::translate(glm::mat4(1.0f), t) * glm::mat4_cast(r) * glm::scale(glm::mat4(1.0f), s);
+}
+
+// Every node starts dirty, so the first updateWorld() computes all of them
+SceneHierarchy loadSceneHierarchy(const json& j) {
+    SceneHierarchy hierarchy;
+    int nodeCount = j.contains("nodes") ? (int)j["nodes"].size() : 0;
+    std::vector<int> gltfParent(nodeCount, -1);
+    for (int i = 0; i < nodeCount; i++) {
+        const auto& node = j["nodes"][i];
+        if (node.contains("children")) {
+            for (int child : node["children"]) gltfParent[child] = i;
+        }
+    }
+
+    // GLTF doesn't order parents before children, so walk the hierarchy once
+    std::vector<int> stack;
+    for (int i = nodeCount - 1; i >= 0; i--) {
+        if (gltfParent[i] < 0) stack.push_back(i);
+    }
+    hierarchy.sortedIndex.assign(nodeCount, -1);
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        hierarchy.sortedIndex[node] = (int)hierarchy.gltfNode.size();
+        hierarchy.gltfNode.push_back(node);
+        const auto& n = j["nodes"][node];
+        if (n.contains("children")) {
+            for (int c = (int)n["children"].size() - 1; c >= 0; c--) stack.push_back(n["children"][c]);
+        }
+    }
+
+    int count = (int)hierarchy.gltfNode.size();
+    hierarchy.parent.resize(count);
+    hierarchy.local.resize(count);
+    hierarchy.world.resize(count);
+    hierarchy.dirty.assign(count, 1);
+    for (int i = 0; i < count; i++) {
+        int node = hierarchy.gltfNode[i];
+        hierarchy.parent[i] = (gltfParent[node] >= 0) ? hierarchy.sortedIndex[gltfParent[node]] : -1;
+        hierarchy.local[i] = nodeLocalTransform(j["nodes"][node]);
+    }
+    hierarchy.subtreeEnd.resize(count);
+    for (int i = count - 1; i >= 0; i--) {
+        hierarchy.subtreeEnd[i] = glm::max(hierarchy.subtreeEnd[i], i + 1);
+        int p = hierarchy.parent[i];
+        if (p >= 0) hierarchy.subtreeEnd[p] = glm::max(hierarchy.subtreeEnd[p], hierarchy.subtreeEnd[i]);
+    }
+    return hierarchy;
+}
+
+// Animation Clips
+// A clip animates a fixed set of joints, with one track per joint. The tracks
+// are compressed:
+//   - rotations are stored smallest-three in 48 bits;
+//   - translations are unorm16 within the track's bounds;
+//   - key times are frame numbers at ANIMATION_RATE.
+// Curve fitting keeps only the keys that linear interpolation can't reproduce
+// within tolerance, so a still joint costs one key. Sampling decodes the two
+// keys around the time per joint, then interpolates four joints per SSE op;
+// crossfades blend two sampled poses the same way.
+const float ANIMATION_RATE = 30.0f;
+const float ROTATION_TOLERANCE = 0.002f;     // radians
+const float TRANSLATION_TOLERANCE = 0.0005f; // fraction of the track's extent
+
+struct AnimationTrack {
+    std::vector<unsigned short> rotationFrames;
+    std::vector<unsigned short> rotations;       // 3 per key
+    std::vector<unsigned short> translationFrames;
+    std::vector<unsigned short> translations;    // 3 per key
+    glm::vec3 translationMin = glm::vec3(0.0f);
+    glm::vec3 translationExtent = glm::vec3(0.0f);
+};
+
+struct AnimationClip {
+    std::string name;
+    float duration = 0.0f;
+    bool loop = false;
+    std::vector<AnimationTrack> tracks; // per animated joint
+};
+
+// Uncompressed clip, sampled every frame
+struct DenseClip {
+    std::string name;
+    bool loop = false;
+    int frames = 0;
+    std::vector<std::vector<glm::quat>> rotations;    // per joint, per frame
+    std::vector<std::vector<glm::vec3>> translations;
+};
+
+// Structure of arrays, padded to a multiple of four joints
+struct AnimationPose {
+    std::vector<float> rotation[4]; // x, y, z, w
+    std::vector<float> translation[3];
+
+    void resize(int joints) {
+        int padded = (joints + 3) & ~3;
+        for (auto& r : rotation) r.assign(padded, 0.0f);
+        for (auto& t : translation) t.assign(padded, 0.0f);
+        rotation[3].assign(padded, 1.0f);
+    }
+    int capacity() const { return (int)rotation[0].size(); }
+};
+
+// Smallest three: the largest component is dropped (made positive, since q and -q
+// are the same rotation) and the other three fit in [-1/sqrt2, 1/sqrt2] at 15 bits.
+// Its index goes in the top bits of the first two words.
+void encodeQuat(glm::quat q, unsigned short* out) {
+    float c[4] = {q.x, q.y, q.z, q.w};
+    int largest = 0;
+    for (int i = 1; i < 4; i++) {
+        if (fabsf(c[i]) > fabsf(c[largest])) largest = i;
+    }
+    float sign = (c[largest] < 0.0f) ? -1.0f : 1.0f;
+    for (int i = 0, k = 0; i < 4; i++) {
+        if (i == largest) continue;
+        float unit = glm::clamp((c[i] * sign * 1.41421356f + 1.0f) * 0.5f, 0.0f, 1.0f);
+        out[k++] = (unsigned short)lroundf(unit * 32767.0f);
+    }
+    out[0] |= (unsigned short)((largest >> 1) << 15);
+    out[1] |= (unsigned short)((largest & 1) << 15);
+}
+
+glm::quat decodeQuat(const unsigned short* in) {
+    int largest = ((in[0] >> 15) << 1) | (in[1] >> 15);
+    float c[4], sum = 0.0f;
+    for (int i = 0, k = 0; i < 4; i++) {
+        if (i == largest) continue;
+        c[i] = ((in[k++] & 0x7fff) * (2.0f / 32767.0f) - 1.0f) * 0.70710678f;
+        sum += c[i] * c[i];
+    }
+    c[largest] = sqrtf(glm::max(0.0f, 1.0f - sum));
+    return glm::quat(c[3], c[0], c[1], c[2]);
+}
+
+glm::quat nlerp(glm::quat a, glm::quat b, float t) {
+    if (glm::dot(a, b) < 0.0f) b = -b;
+    return glm::normalize(a * (1.0f - t) + b * t);
+}
+
+// Greedy curve fit: each segment runs as far as interpolating its end keys
+// stays within tolerance of every sample in between
+template <typename T, typename CloseFn, typename LerpFn>
+std::vector<int> fitKeys(const std::vector<T>& samples, CloseFn close, LerpFn lerp) {
+    std::vector<int> keys = {0};
+    int last = (int)samples.size() - 1;
+    for (int start = 0; start < last;) {
+        int end = start + 1;
+        while (end < last) {
+            bool fits = true;
+            for (int k = start + 1; k <= end && fits; k++) {
+                fits = close(lerp(samples[start], samples[end + 1], (float)(k - start) / (end + 1 - start)), samples[k]);
+            }
+            if (!fits) break;
+            end++;
+        }
+        keys.push_back(end);
+        start = end;
+    }
+    // A joint that never moves needs a single key
+    bool still = true;
+    for (int i = 1; i <= last && still; i++) still = close(samples[0], samples[i]);
+    if (still) keys.resize(1);
+    return keys;
+}
+
+AnimationClip compressClip(const DenseClip& dense) {
+    AnimationClip clip;
+    clip.name = dense.name;
+    clip.loop = dense.loop;
+    clip.duration = (dense.frames - 1) / ANIMATION_RATE;
+    for (size_t joint = 0; joint < dense.rotations.size(); joint++) {
+        AnimationTrack track;
+        // Fit against the quantized values, so the tolerance covers both errors
+        std::vector<glm::quat> rotations(dense.frames);
+        std::vector<unsigned short> encoded(dense.frames * 3);
+        for (int f = 0; f < dense.frames; f++) {
+            encodeQuat(dense.rotations[joint][f], &encoded[f * 3]);
+            rotations[f] = decodeQuat(&encoded[f * 3]);
+        }
+        auto rotationClose = [](const glm::quat& a, const glm::quat& b) {
+            return 2.0f * acosf(glm::min(1.0f, fabsf(glm::dot(a, b)))) <= ROTATION_TOLERANCE;
+        };
+        for (int key : fitKeys(rotations, rotationClose, nlerp)) {
+            track.rotationFrames.push_back((unsigned short)key);
+            track.rotations.insert(track.rotations.end(), &encoded[key * 3], &encoded[key * 3 + 3]);
+        }
+
+        const std::vector<glm::vec3>& source = dense.translations[joint];
+        glm::vec3 lo = source[0], hi = source[0];
+        for (const glm::vec3& t : source) {
+            lo = glm::min(lo, t);
+            hi = glm::max(hi, t);
+        }
+        track.translationMin = lo;
+        track.translationExtent = hi - lo;
+        std::vector<glm::vec3> translations(dense.frames);
+        encoded.assign(dense.frames * 3, 0);
+        for (int f = 0; f < dense.frames; f++) {
+            for (int c = 0; c < 3; c++) {
+                float unit = (hi[c] > lo[c]) ? (source[f][c] - lo[c]) / (hi[c] - lo[c]) : 0.0f;
+                encoded[f * 3 + c] = (unsigned short)lroundf(unit * 65535.0f);
+                translations[f][c] = lo[c] + encoded[f * 3 + c] * (1.0f / 65535.0f) * track.translationExtent[c];
+            }
+        }
+        float tolerance = TRANSLATION_TOLERANCE * glm::max(track.translationExtent.x, glm::max(track.translationExtent.y, track.translationExtent.z));
+        auto translationClose = [tolerance](const glm::vec3& a, const glm::vec3& b) { return glm::length(a - b) <= tolerance; };
+        auto lerp = [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); };
+        for (int key : fitKeys(translations, translationClose, lerp)) {
+            track.translationFrames.push_back((unsigned short)key);
+            track.translations.insert(track.translations.end(), &encoded[key * 3], &encoded[key * 3 + 3]);
+        }
+        clip.tracks.push_back(track);
+    }
+    return clip;
+}
+
+// Per-joint interpolation over a pose: out = nlerp(a, b, alpha) for rotations and
+// lerp for translations, four joints per SSE op. out may alias a or b.
+void interpolatePoses(const AnimationPose& a, const AnimationPose& b, const float* rotationAlpha, const float* translationAlpha, AnimationPose& out) {
+    int count = a.capacity();
+#if defined(__SSE__) || defined(_M_X64)
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (int j = 0; j < count; j += 4) {
+        __m128 ar[4], br[4];
+        for (int c = 0; c < 4; c++) {
+            ar[c] = _mm_loadu_ps(&a.rotation[c][j]);
+            br[c] = _mm_loadu_ps(&b.rotation[c][j]);
+        }
+        // Take the short way round: flip b where the dot product is negative
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ar[0], br[0]), _mm_mul_ps(ar[1], br[1])),
+                                _mm_add_ps(_mm_mul_ps(ar[2], br[2]), _mm_mul_ps(ar[3], br[3])));
+        __m128 flip = _mm_and_ps(dot, signMask);
+        __m128 alpha = _mm_loadu_ps(rotationAlpha + j);
+        __m128 r[4], length = _mm_setzero_ps();
+        for (int c = 0; c < 4; c++) {
+            r[c] = _mm_add_ps(ar[c], _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(br[c], flip), ar[c]), alpha));
+            length = _mm_add_ps(length, _mm_mul_ps(r[c], r[c]));
+        }
+        __m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length));
+        for (int c = 0; c < 4; c++) _mm_storeu_ps(&out.rotation[c][j], _mm_mul_ps(r[c], inverseLength));
+
+        alpha = _mm_loadu_ps(translationAlpha + j);
+        for (int c = 0; c < 3; c++) {
+            __m128 at = _mm_loadu_ps(&a.translation[c][j]);
+            __m128 bt = _mm_loadu_ps(&b.translation[c][j]);
+            _mm_storeu_ps(&out.translation[c][j], _mm_add_ps(at, _mm_mul_ps(_mm_sub_ps(bt, at), alpha)));
+        }
+    }
+#else
+    for (int j = 0; j < count; j++) {
+        glm::quat qa(a.rotation[3][j], a.rotation[0][j], a.rotation[1][j], a.rotation[2][j]);
+        glm::quat qb(b.rotation[3][j], b.rotation[0][j], b.rotation[1][j], b.rotation[2][j]);
+        glm::quat q = nlerp(qa, qb, rotationAlpha[j]);
+        out.rotation[0][j] = q.x;
+        out.rotation[1][j] = q.y;
+        out.rotation[2][j] = q.z;
+        out.rotation[3][j] = q.w;
+        for (int c = 0; c < 3; c++) out.translation[c][j] = glm::mix(a.translation[c][j], b.translation[c][j], translationAlpha[j]);
+    }
+#endif
+}
+
+// Scratch for one sample: the keys on each side of the time and how far between them
+struct AnimationSampler {
+    AnimationPose before, after;
+    std::vector<float> rotationAlpha, translationAlpha;
+    std::vector<float> blendAlpha;
+};
+
+// Finds the keys around frame and writes the first one's index and the fraction to the next
+int findKey(const std::vector<unsigned short>& frames, float frame, float& alpha) {
+    int next = (int)(std::upper_bound(frames.begin(), frames.end(), (unsigned short)glm::min(frame, 65535.0f)) - frames.begin());
+    if (next == 0 || next == (int)frames.size()) {
+        alpha = 0.0f;
+        return glm::max(next - 1, 0);
+    }
+    alpha = (frame - frames[next - 1]) / (float)(frames[next] - frames[next - 1]);
+    return next - 1;
+}
+
+void sampleClip(const AnimationClip& clip, float time, AnimationSampler& sampler, AnimationPose& out) {
+    int padded = out.capacity();
+    if (sampler.before.capacity() != padded) {
+        sampler.before.resize((int)clip.tracks.size());
+        sampler.after.resize((int)clip.tracks.size());
+        sampler.rotationAlpha.assign(padded, 0.0f);
+        sampler.translationAlpha.assign(padded, 0.0f);
+    }
+    float frame = glm::clamp(time, 0.0f, clip.duration) * ANIMATION_RATE;
+    for (size_t j = 0; j < clip.tracks.size(); j++) {
+        const AnimationTrack& track = clip.tracks[j];
+        int key = findKey(track.rotationFrames, frame, sampler.rotationAlpha[j]);
+        int nextKey = glm::min(key + 1, (int)track.rotationFrames.size() - 1);
+        glm::quat a = decodeQuat(&track.rotations[key * 3]), b = decodeQuat(&track.rotations[nextKey * 3]);
+        sampler.before.rotation[0][j] = a.x, sampler.before.rotation[1][j] = a.y, sampler.before.rotation[2][j] = a.z, sampler.before.rotation[3][j] = a.w;
+        sampler.after.rotation[0][j] = b.x, sampler.after.rotation[1][j] = b.y, sampler.after.rotation[2][j] = b.z, sampler.after.rotation[3][j] = b.w;
+
+        key = findKey(track.translationFrames, frame, sampler.translationAlpha[j]);
+        nextKey = glm::min(key + 1, (int)track.translationFrames.size() - 1);
+        for (int c = 0; c < 3; c++) {
+            float scale = track.translationExtent[c] * (1.0f / 65535.0f);
+            sampler.before.translation[c][j] = track.translationMin[c] + track.translations[key * 3 + c] * scale;
+            sampler.after.translation[c][j] = track.translationMin[c] + track.translations[nextKey * 3 + c] * scale;
+        }
+    }
+    interpolatePoses(sampler.before, sampler.after, sampler.rotationAlpha.data(), sampler.translationAlpha.data(), out);
+}
+
+// Plays one clip, crossfading from the previous one over fadeDuration
+struct AnimationPlayer {
+    int clip = -1, previousClip = -1;
+    float time = 0.0f, previousTime = 0.0f;
+    float fade = 1.0f, fadeDuration = 0.0f; // fade reaches 1 when the previous clip is gone
+    AnimationPose pose, previousPose;
+
+    void play(int newClip, float crossfade) {
+        if (clip >= 0 && crossfade > 0.0f) {
+            previousClip = clip;
+            previousTime = time;
+            fade = 0.0f;
+            fadeDuration = crossfade;
+        } else {
+            fade = 1.0f;
+        }
+        clip = newClip;
+        time = 0.0f;
+    }
+
+    // True while a one-shot clip or a crossfade has yet to finish; loops never do
+    bool finishing(const std::vector<AnimationClip>& clips) const {
+        return clip >= 0 && ((!clips[clip].loop && time < clips[clip].duration) || fade < 1.0f);
+    }
+
+    // Returns false once the pose can't change any more (a finished one-shot clip)
+    bool advance(const std::vector<AnimationClip>& clips, float dt) {
+        if (clip < 0) return false;
+        bool moving = clips[clip].loop || time < clips[clip].duration || fade < 1.0f;
+        time += dt;
+        if (clips[clip].loop && clips[clip].duration > 0.0f) time = fmodf(time, clips[clip].duration);
+        if (fade < 1.0f) {
+            previousTime += dt;
+            if (clips[previousClip].loop && clips[previousClip].duration > 0.0f) previousTime = fmodf(previousTime, clips[previousClip].duration);
+            fade = glm::min(1.0f, fade + dt / fadeDuration);
+        }
+        return moving;
+    }
+
+    void sample(const std::vector<AnimationClip>& clips, AnimationSampler& sampler) {
+        int joints = (int)clips[clip].tracks.size();
+        if (pose.capacity() != ((joints + 3) & ~3)) {
+            pose.resize(joints);
+            previousPose.resize(joints);
+        }
+        sampleClip(clips[clip], time, sampler, pose);
+        if (fade >= 1.0f) return;
+        sampleClip(clips[previousClip], previousTime, sampler, previousPose);
+        // Smoothstep, so the blend doesn't jerk at either end
+        float weight = fade * fade * (3.0f - 2.0f * fade);
+        sampler.blendAlpha.assign(pose.capacity(), weight);
+        interpolatePoses(previousPose, pose, sampler.blendAlpha.data(), sampler.blendAlpha.data(), pose);
+    }
+};
+
+// Skeleton
+// Node hierarchy of a GLTF skin. Only joints that vertices actually reference
+// get a palette slot, which keeps the palette small enough for a uniform block.
+const int MAX_JOINTS = 128;
+
+struct Skeleton {
+    SceneHierarchy nodes;
+    std::vector<glm::mat4> restLocal; // bind-pose local transforms, in sorted order
+
+    std::vector<int> jointNodes;          // palette slot -> sorted node
+    std::vector<glm::mat4> inverseBind;   // per palette slot
+    std::vector<glm::mat4> palette;       // world * inverseBind, per palette slot
+
+    // Clips and the nodes they animate; scale stays at the bind pose
+    std::vector<AnimationClip> clips;
+    std::vector<int> animatedNodes;       // animated joint -> sorted node
+    std::vector<glm::vec3> animatedScale;
+
+    // Which side each wing extends to, so mirrored wings swing the same way
+    int wingNodes[2] = {-1, -1};
+    float wingSide[2] = {1.0f, 1.0f};
+
+    // Returns false when nothing moved, so the palette from last time still holds
+    bool updateWorld() {
+        if (nodes.updateWorld() == 0) return false;
+        for (size_t slot = 0; slot < jointNodes.size(); slot++) {
+            multiplyMat4(nodes.world[jointNodes[slot]], inverseBind[slot], palette[slot]);
+        }
+        return true;
+    }
+
+    int findClip(const std::string& name) const {
+        for (size_t i = 0; i < clips.size(); i++) {
+            if (clips[i].name == name) return (int)i;
+        }
+        return -1;
+    }
+
+    glm::mat4 poseLocal(const AnimationPose& pose, int joint) const {
+        glm::quat r(pose.rotation[3][joint], pose.rotation[0][joint], pose.rotation[1][joint], pose.rotation[2][joint]);
+        glm::mat4 local = glm::mat4_cast(r);
+        for (int c = 0; c < 3; c++) {
+            local[c] *= animatedScale[joint][c];
+            local[3][c] = pose.translation[c][joint];
+        }
+        return local;
+    }
+
+    bool applyPose(const AnimationPose& pose) {
+        for (size_t joint = 0; joint < animatedNodes.size(); joint++) nodes.setLocal(animatedNodes[joint], poseLocal(pose, (int)joint));
+        return updateWorld();
+    }
+};
+
+void loadSkeletonNodes(const json& j, Skeleton& skeleton) {
+    skeleton.nodes = loadSceneHierarchy(j);
+    skeleton.restLocal = skeleton.nodes.local;
+}
+
+// Finds the shoulder nodes and which side each wing extends to, from the bind pose
+void findWings(const json& j, Skeleton& skeleton) {
+    const char* names[2] = {"ORG-shoulder.L", "ORG-shoulder.R"};
+    SceneHierarchy& nodes = skeleton.nodes;
+    skeleton.updateWorld();
+    for (int w = 0; w < 2; w++) {
+        for (int i = 0; i < (int)j["nodes"].size(); i++) {
+            if (j["nodes"][i].contains("name") && j["nodes"][i]["name"] == names[w]) skeleton.wingNodes[w] = nodes.sortedIndex[i];
+        }
+        int node = skeleton.wingNodes[w];
+        if (node < 0) continue;
+
+        // The descendant farthest from the shoulder along x is the wing tip
+        float tipOffset = 0.0f;
+        for (int i = node + 1; i < nodes.subtreeEnd[node]; i++) {
+            float dx = nodes.world[i][3].x - nodes.world[node][3].x;
+            if (fabsf(dx) > fabsf(tipOffset)) tipOffset = dx;
+        }
+        skeleton.wingSide[w] = (tipOffset < 0.0f) ? -1.0f : 1.0f;
+    }
+}
+
+// Built-in clips, baked for files that don't author their own. Each joint swings
+// about a model-space axis through its bind-pose origin (the body's forward axis
+// is z); wing angles are mirrored by side.
+struct ProceduralJoint {
+    const char* name;
+    int group; // shoulder, elbow, tail, head, thigh
+    glm::vec3 axis;
+    int wing;  // wingSide index, -1 if unmirrored
+};
+
+const ProceduralJoint PROCEDURAL_JOINTS[] = {
+    {"ORG-shoulder.L", 0, glm::vec3(0.0f, 0.0f, 1.0f), 0}, {"ORG-shoulder.R", 0, glm::vec3(0.0f, 0.0f, 1.0f), 1},
+    {"ORG-Wing.L", 1, glm::vec3(0.0f, 0.0f, 1.0f), 0},     {"ORG-Wing.R", 1, glm::vec3(0.0f, 0.0f, 1.0f), 1},
+    {"ORG-t_feather.L", 2, glm::vec3(1.0f, 0.0f, 0.0f), -1}, {"ORG-t_feather.R", 2, glm::vec3(1.0f, 0.0f, 0.0f), -1},
+    {"ORG-head", 3, glm::vec3(1.0f, 0.0f, 0.0f), -1},
+    {"ORG-thigh.L", 4, glm::vec3(1.0f, 0.0f, 0.0f), -1},   {"ORG-thigh.R", 4, glm::vec3(1.0f, 0.0f, 0.0f), -1},
+};
+
+struct ProceduralClip {
+    const char* name;
+    float duration;
+    bool loop;
+};
+
+const ProceduralClip PROCEDURAL_CLIPS[] = {{"glide", 2.0f, true}, {"flap", 1.0f, false}, {"crash", 0.5f, false}};
+
+// Degrees for each joint group at time t
+void proceduralAngles(const std::string& clip, float t, float angles[5]) {
+    const float pi = 3.14159265f;
+    if (clip == "flap") {
+        // Wings snap up on the jump and beat down with a decaying oscillation;
+        // the elbows lag the shoulders and the legs tuck in
+        float decay = expf(-4.0f * t);
+        angles[0] = 50.0f * cosf(t * 2.0f * pi * 4.0f) * decay;
+        angles[1] = 25.0f * cosf(t * 2.0f * pi * 4.0f - 0.8f) * decay;
+        angles[2] = 8.0f * sinf(t * 2.0f * pi * 4.0f) * decay;
+        angles[3] = -4.0f * sinf(t * 2.0f * pi * 4.0f) * decay;
+        angles[4] = 20.0f * decay;
+    } else if (clip == "crash") {
+        // Wings and head droop, tail and legs splay, then the pose holds
+        float e = glm::smoothstep(0.0f, 1.0f, t / 0.5f);
+        angles[0] = -45.0f * e;
+        angles[1] = -30.0f * e;
+        angles[2] = 20.0f * e;
+        angles[3] = 30.0f * e;
+        angles[4] = 40.0f * e;
+    } else {
+        // Glide: a slow sway that loops every two seconds
+        float phase = t * 2.0f * pi / 2.0f;
+        angles[0] = 6.0f + 4.0f * sinf(phase);
+        angles[1] = 3.0f * sinf(phase - 0.7f);
+        angles[2] = 3.0f * sinf(2.0f * phase);
+        angles[3] = 2.0f * sinf(phase + 1.0f);
+        angles[4] = 10.0f;
+    }
+}
+
+// Authored GLTF animations (rotation and translation channels, resampled at
+// ANIMATION_RATE), plus built-in clips for whichever of glide, flap and crash
+// the file lacks. Runs once the bind pose is in the skeleton's world matrices.
+void loadAnimations(const json& j, const std::vector<unsigned char>& bin, Skeleton& skeleton, const std::string& name) {
+    const SceneHierarchy& nodes = skeleton.nodes;
+    std::vector<int> jointOf(nodes.parent.size(), -1); // sorted node -> animated joint
+    auto addJoint = [&](int sorted) {
+        if (jointOf[sorted] < 0) {
+            jointOf[sorted] = (int)skeleton.animatedNodes.size();
+            skeleton.animatedNodes.push_back(sorted);
+        }
+        return jointOf[sorted];
+    };
+
+    const int proceduralCount = sizeof(PROCEDURAL_JOINTS) / sizeof(PROCEDURAL_JOINTS[0]);
+    int proceduralJoint[proceduralCount];
+    for (int p = 0; p < proceduralCount; p++) {
+        proceduralJoint[p] = -1;
+        for (int i = 0; i < (int)j["nodes"].size(); i++) {
+            const json& node = j["nodes"][i];
+            if (node.contains("name") && node["name"] == PROCEDURAL_JOINTS[p].name) proceduralJoint[p] = addJoint(nodes.sortedIndex[i]);
+        }
+    }
+    const json empty = json::array();
+    const json& animations = j.contains("animations") ? j["animations"] : empty;
+    for (const auto& animation : animations) {
+        for (const auto& channel : animation["channels"]) {
+            const json& target = channel["target"];
+            if (target.contains("node") && (target["path"] == "rotation" || target["path"] == "translation")) addJoint(nodes.sortedIndex[(int)target["node"]]);
+        }
+    }
+    int jointCount = (int)skeleton.animatedNodes.size();
+    if (jointCount == 0) return;
+
+    // Bind pose of each animated joint, which every clip starts from
+    std::vector<glm::quat> restRotation(jointCount), bindRotation(jointCount);
+    std::vector<glm::vec3> restTranslation(jointCount);
+    skeleton.animatedScale.resize(jointCount);
+    for (int joint = 0; joint < jointCount; joint++) {
+        int node = skeleton.animatedNodes[joint];
+        const glm::mat4& rest = skeleton.restLocal[node];
+        glm::vec3 scale(glm::length(glm::vec3(rest[0])), glm::length(glm::vec3(rest[1])), glm::length(glm::vec3(rest[2])));
+        skeleton.animatedScale[joint] = scale;
+        restTranslation[joint] = glm::vec3(rest[3]);
+        restRotation[joint] = glm::normalize(glm::quat_cast(glm::mat3(glm::vec3(rest[0]) / scale.x, glm::vec3(rest[1]) / scale.y, glm::vec3(rest[2]) / scale.z)));
+        const glm::mat4& world = nodes.world[node];
+        bindRotation[joint] = glm::normalize(glm::quat_cast(glm::mat3(glm::normalize(glm::vec3(world[0])), glm::normalize(glm::vec3(world[1])), glm::normalize(glm::vec3(world[2])))));
+    }
+    auto restClip = [&](const std::string& clipName, bool loop, float duration) {
+        DenseClip dense;
+        dense.name = clipName;
+        dense.loop = loop;
+        dense.frames = (int)ceilf(duration * ANIMATION_RATE) + 1;
+        for (int joint = 0; joint < jointCount; joint++) {
+            dense.rotations.push_back(std::vector<glm::quat>(dense.frames, restRotation[joint]));
+            dense.translations.push_back(std::vector<glm::vec3>(dense.frames, restTranslation[joint]));
+        }
+        return dense;
+    };
+
+    std::vector<DenseClip> denseClips;
+    for (const auto& animation : animations) {
+        std::string clipName = animation.contains("name") ? animation["name"].get<std::string>() : "clip" + std::to_string(denseClips.size());
+        std::transform(clipName.begin(), clipName.end(), clipName.begin(), ::tolower);
+        float duration = 0.0f;
+        for (const auto& sampler : animation["samplers"]) {
+            const json& input = j["accessors"][(int)sampler["input"]];
+            if (input.contains("max")) duration = glm::max(duration, (float)input["max"][0]);
+        }
+        DenseClip dense = restClip(clipName, clipName != "flap" && clipName != "crash", duration);
+        for (const auto& channel : animation["channels"]) {
+            const json& target = channel["target"];
+            bool rotation = target["path"] == "rotation";
+            if (!target.contains("node") || (!rotation && target["path"] != "translation")) continue;
+            int joint = jointOf[nodes.sortedIndex[(int)target["node"]]];
+            const json& sampler = animation["samplers"][(int)channel["sampler"]];
+            std::string interpolation = sampler.contains("interpolation") ? sampler["interpolation"].get<std::string>() : "LINEAR";
+            const json& input = j["accessors"][(int)sampler["input"]];
+            AccessorReader times = accessorReader(j, bin, input);
+            AccessorReader values = accessorReader(j, bin, j["accessors"][(int)sampler["output"]]);
+            int keyCount = input["count"];
+            int stride = (interpolation == "CUBICSPLINE") ? 3 : 1; // in-tangent, value, out-tangent; tangents are ignored
+            int valueOffset = (interpolation == "CUBICSPLINE") ? 1 : 0;
+            auto value = [&](int key) {
+                int i = key * stride + valueOffset;
+                return glm::vec4(values.read(i, 0), values.read(i, 1), values.read(i, 2), rotation ? values.read(i, 3) : 0.0f);
+            };
+            for (int f = 0, key = 0; f < dense.frames && keyCount > 0; f++) {
+                float t = f / ANIMATION_RATE;
+                while (key + 1 < keyCount && times.read(key + 1, 0) <= t) key++;
+                float t0 = times.read(key, 0), t1 = (key + 1 < keyCount) ? times.read(key + 1, 0) : t0;
+                float alpha = (interpolation == "STEP" || t1 <= t0) ? 0.0f : glm::clamp((t - t0) / (t1 - t0), 0.0f, 1.0f);
+                glm::vec4 a = value(key), b = value(glm::min(key + 1, keyCount - 1));
+                if (rotation) dense.rotations[joint][f] = glm::slerp(glm::quat(a.w, a.x, a.y, a.z), glm::quat(b.w, b.x, b.y, b.z), alpha);
+                else dense.translations[joint][f] = glm::mix(glm::vec3(a), glm::vec3(b), alpha);
+            }
+        }
+        denseClips.push_back(dense);
+    }
+
+    for (const ProceduralClip& procedural : PROCEDURAL_CLIPS) {
+        bool authored = false;
+        for (const DenseClip& dense : denseClips) authored = authored || dense.name == procedural.name;
+        if (authored) continue;
+        DenseClip dense = restClip(procedural.name, procedural.loop, procedural.duration);
+        for (int f = 0; f < dense.frames; f++) {
+            float angles[5];
+            proceduralAngles(procedural.name, f / ANIMATION_RATE, angles);
+            for (int p = 0; p < proceduralCount; p++) {
+                int joint = proceduralJoint[p];
+                if (joint < 0) continue;
+                const ProceduralJoint& pj = PROCEDURAL_JOINTS[p];
+                float angle = glm::radians(angles[pj.group]) * (pj.wing >= 0 ? skeleton.wingSide[pj.wing] : 1.0f);
+                // The model-space swing, moved into the joint's own frame
+                glm::quat swing = glm::angleAxis(angle, pj.axis);
+                dense.rotations[joint][f] = glm::normalize(restRotation[joint] * glm::inverse(bindRotation[joint]) * swing * bindRotation[joint]);
+            }
+        }
+        denseClips.push_back(dense);
+    }
+
+    size_t denseKeys = 0, keys = 0, bytes = 0;
+    for (const DenseClip& dense : denseClips) {
+        skeleton.clips.push_back(compressClip(dense));
+        denseKeys += (size_t)dense.frames * jointCount * 2;
+        for (const AnimationTrack& track : skeleton.clips.back().tracks) {
+            keys += track.rotationFrames.size() + track.translationFrames.size();
+            bytes += (track.rotationFrames.size() + track.translationFrames.size()) * 8 + sizeof(glm::vec3) * 2;
+        }
+    }
+    std::cout << name << ": " << skeleton.clips.size() << " clips (" << animations.size() << " authored) over " << jointCount
+              << " joints, " << keys << " of " << denseKeys << " keys kept, " << bytes / 1024.0f << " KB" << std::endl;
+}
+
+// --anim-bench N: CPU cost of sampling N birds' clips, half of them mid-crossfade,
+// and building their joints' local matrices (a crowd of birds sharing one skeleton)
+void runAnimationBenchmark(const Skeleton& skeleton, int birds) {
+    int glide = skeleton.findClip("glide"), flap = skeleton.findClip("flap");
+    if (glide < 0 || flap < 0) {
+        std::cout << "Animation benchmark needs glide and flap clips" << std::endl;
+        return;
+    }
+    std::vector<AnimationPlayer> players(birds);
+    for (int i = 0; i < birds; i++) {
+        players[i].play(glide, 0.0f);
+        players[i].advance(skeleton.clips, (i % 60) * SIM_DT);
+        // Odd birds stay mid-crossfade for the whole run
+        players[i].play(flap, (i & 1) ? 1e6f : 0.0f);
+    }
+    AnimationSampler sampler;
+    std::vector<glm::mat4> locals(skeleton.animatedNodes.size());
+    const int rounds = 100;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (AnimationPlayer& player : players) {
+            player.advance(skeleton.clips, SIM_DT);
+            player.sample(skeleton.clips, sampler);
+            for (size_t joint = 0; joint < locals.size(); joint++) locals[joint] = skeleton.poseLocal(player.pose, (int)joint);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Animation: " << birds << " birds, " << locals.size() << " joints, " << seconds * 1000.0 / rounds << " ms per update ("
+              << seconds * 1e6 / rounds / birds << " us per bird)" << std::endl;
+}
+
+// Interleaved vertex of a merged model (28 bytes): the compact attributes,
+// palette slots and unorm8 weights for GPU skinning, and the material slot
+struct ModelVertex {
+    CompactVertex base;
+    unsigned char joints[4];
+    unsigned char weights[4];
+    unsigned char material;
+    unsigned char padding[3];
+};
+
+// Uploads the merged buffers and material block; attributes 0-5 match the scene shader
+void createModelBuffers(GLTFModel& model, const std::vector<ModelVertex>& vertices, const void* indices, size_t indexBytes) {
+    glGenVertexArrays(1, &model.VAO);
+    glBindVertexArray(model.VAO);
+
+    glGenBuffers(1, &model.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, model.VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ModelVertex), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, base.position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, base.normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, base.texCoord));
+    glEnableVertexAttribArray(2);
+    glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, joints));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, weights));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(5, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, material));
+    glEnableVertexAttribArray(5);
+
+    glGenBuffers(1, &model.EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    // Colors, then atlas rects (zero until setMaterialRects places the images)
+    std::vector<glm::vec4> block(MAX_MATERIALS * 2, glm::vec4(0.0f));
+    for (int i = 0; i < MAX_MATERIALS; i++) block[i] = i < (int)model.materials.size() ? model.materials[i] : glm::vec4(1.0f);
+    glGenBuffers(1, &model.materialUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, model.materialUBO);
+    glBufferData(GL_UNIFORM_BUFFER, block.size() * sizeof(glm::vec4), block.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Atlas rects of the textured material slots, once their images are in the atlas
+void setMaterialRects(GLTFModel& model, const std::vector<glm::vec4>& rects) {
+    int count = glm::min((int)rects.size(), MAX_MATERIALS);
+    glBindBuffer(GL_UNIFORM_BUFFER, model.materialUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(glm::vec4), count * sizeof(glm::vec4), rects.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Second VAO for the CPU path: skinned positions/normals come from a dynamic
+// float buffer, everything else from the model buffer
+void createCpuSkinBuffers(GLTFModel& model) {
+    CpuSkin& skin = model.cpuSkin;
+    skin.output.resize(skin.positions.size() * 2);
+
+    glGenVertexArrays(1, &skin.VAO);
+    glBindVertexArray(skin.VAO);
+    glGenBuffers(1, &skin.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, skin.VBO);
+    glBufferData(GL_ARRAY_BUFFER, skin.output.size() * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)sizeof(glm::vec4));
+    glEnableVertexAttribArray(1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, model.VBO);
+    glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, base.texCoord));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(5, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, material));
+    glEnableVertexAttribArray(5);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.EBO);
+    glBindVertexArray(0);
+}
+
+void destroyModel(GLTFModel& model) {
+    glDeleteVertexArrays(1, &model.VAO);
+    glDeleteBuffers(1, &model.VBO);
+    glDeleteBuffers(1, &model.EBO);
+    glDeleteBuffers(1, &model.materialUBO);
+    if (model.cpuSkin.VAO) {
+        glDeleteVertexArrays(1, &model.cpuSkin.VAO);
+        glDeleteBuffers(1, &model.cpuSkin.VBO);
+    }
+    model = GLTFModel();
+}
+
+// Linear blend skinning on the CPU, one vertex per iteration with the
+// blended matrix held in four SSE registers
+void skinMeshCpu(CpuSkin& skin, const std::vector<glm::mat4>& palette) {
+    size_t count = skin.positions.size();
+    for (size_t v = 0; v < count; v++) {
+        const unsigned char* j = &skin.joints[v * 4];
+        const glm::vec4& w = skin.weights[v];
+        if (w.x + w.y + w.z + w.w == 0.0f) { // rigid submesh
+            skin.output[v * 2] = skin.positions[v];
+            skin.output[v * 2 + 1] = skin.normals[v];
+            continue;
+        }
+#if defined(__SSE__) || defined(_M_X64)
+        __m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+        for (int k = 0; k < 4; k++) {
+            if (w[k] == 0.0f) continue;
+            const float* m = glm::value_ptr(palette[j[k]]);
+            __m128 wk = _mm_set1_ps(w[k]);
+            c0 = _mm_add_ps(c0, _mm_mul_ps(wk, _mm_loadu_ps(m)));
+            c1 = _mm_add_ps(c1, _mm_mul_ps(wk, _mm_loadu_ps(m + 4)));
+            c2 = _mm_add_ps(c2, _mm_mul_ps(wk, _mm_loadu_ps(m + 8)));
+            c3 = _mm_add_ps(c3, _mm_mul_ps(wk, _mm_loadu_ps(m + 12)));
+        }
+        const glm::vec4& p = skin.positions[v];
+        const glm::vec4& n = skin.normals[v];
+        __m128 pos = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p.x)), _mm_mul_ps(c1, _mm_set1_ps(p.y))),
+                                _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p.z)), c3));
+        __m128 nrm = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(n.x)), _mm_mul_ps(c1, _mm_set1_ps(n.y))),
+                                _mm_mul_ps(c2, _mm_set1_ps(n.z)));
+        _mm_storeu_ps(glm::value_ptr(skin.output[v * 2]), pos);
+        _mm_storeu_ps(glm::value_ptr(skin.output[v * 2 + 1]), nrm);
+#else
+        glm::mat4 m = w.x * palette[j[0]] + w.y * palette[j[1]] + w.z * palette[j[2]] + w.w * palette[j[3]];
+        skin.output[v * 2] = m * skin.positions[v];
+        skin.output[v * 2 + 1] = m * skin.normals[v];
+#endif
+    }
+
+    glState.bindBuffer(GL_ARRAY_BUFFER, skin.VBO);
+    glBufferData(GL_ARRAY_BUFFER, skin.output.size() * sizeof(glm::vec4), NULL, GL_STREAM_DRAW); // orphan
+    glBufferSubData(GL_ARRAY_BUFFER, 0, skin.output.size() * sizeof(glm::vec4), skin.output.data());
+}
+
+// Mesh Simplification
+// Quadric error edge collapse. A vertex only ever collapses onto an existing
+// neighbour, so every LOD reuses the original vertex buffer and keeps its skin
+// weights untouched; the skin difference between the two vertices is added to
+// the cost so collapses don't smear joint influences across the skeleton.
+// Vertices on open edges (borders, UV and normal seams) are locked so LODs
+// don't crack.
+struct Quadric {
+    double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+    double area = 0;
+
+    void addPlane(glm::dvec3 n, double d, double weight) {
+        xx += weight * n.x * n.x; xy += weight * n.x * n.y; xz += weight * n.x * n.z; xw += weight * n.x * d;
+        yy += weight * n.y * n.y; yz += weight * n.y * n.z; yw += weight * n.y * d;
+        zz += weight * n.z * n.z; zw += weight * n.z * d;
+        ww += weight * d * d;
+        area += weight;
+    }
+
+    void add(const Quadric& q) {
+        xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw; yy += q.yy;
+        yz += q.yz; yw += q.yw; zz += q.zz; zw += q.zw; ww += q.ww;
+        area += q.area;
+    }
+
+    // Area-weighted sum of squared distances from p to the accumulated planes
+    double evaluate(glm::dvec3 p) const {
+        return xx * p.x * p.x + 2 * xy * p.x * p.y + 2 * xz * p.x * p.z + 2 * xw * p.x +
+               yy * p.y * p.y + 2 * yz * p.y * p.z + 2 * yw * p.y +
+               zz * p.z * p.z + 2 * zw * p.z + ww;
+    }
+};
+
+const int LOD_MIN_INDICES = 3000;    // smaller primitives aren't worth simplifying
+const float LOD_PIXEL_ERROR = 0.75f; // allowed on-screen geometric error when picking a LOD
+
+struct LodLevel {
+    std::vector<unsigned int> indices;
+    float error;
+};
+
+// L1 distance between two vertices' joint influences (0 = identical, 2 = disjoint)
+float skinDifference(const std::vector<unsigned char>& joints, const std::vector<glm::vec4>& weights, unsigned int a, unsigned int b) {
+    float diff = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        float matched = 0.0f;
+        for (int k = 0; k < 4; k++) {
+            if (joints[a * 4 + i] == joints[b * 4 + k]) matched += weights[b][k];
+        }
+        diff += fabsf(weights[a][i] - matched);
+    }
+    for (int k = 0; k < 4; k++) {
+        bool shared = false;
+        for (int i = 0; i < 4; i++) shared = shared || joints[a * 4 + i] == joints[b * 4 + k];
+        if (!shared) diff += weights[b][k];
+    }
+    return diff;
+}
+
+// Builds coarser index buffers, one per entry of targetRatios (fraction of the
+// original triangles, descending). joints/weights may be empty for rigid meshes.
+std::vector<LodLevel> buildLodChain(const std::vector<glm::vec3>& positions, const std::vector<unsigned char>& joints,
+                                   const std::vector<glm::vec4>& weights, const std::vector<unsigned int>& indices,
+                                   const std::vector<float>& targetRatios) {
+    size_t vertexCount = positions.size();
+    size_t triCount = indices.size() / 3;
+    std::vector<unsigned int> tris = indices;
+    std::vector<char> triAlive(triCount, 1);
+    std::vector<char> vertexAlive(vertexCount, 1);
+    std::vector<std::vector<unsigned int>> vertexTris(vertexCount);
+    std::vector<Quadric> quadrics(vertexCount);
+    bool hasSkin = !joints.empty();
+
+    for (size_t t = 0; t < triCount; t++) {
+        glm::dvec3 p0 = positions[tris[t * 3]], p1 = positions[tris[t * 3 + 1]], p2 = positions[tris[t * 3 + 2]];
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        double len = glm::length(n);
+        for (int k = 0; k < 3; k++) vertexTris[tris[t * 3 + k]].push_back((unsigned int)t);
+        if (len <= 0.0) continue;
+        n /= len;
+        for (int k = 0; k < 3; k++) quadrics[tris[t * 3 + k]].addPlane(n, -glm::dot(n, p0), len * 0.5);
+    }
+
+    // Edges used by a single triangle are open; lock their vertices
+    std::vector<char> locked(vertexCount, 0);
+    std::unordered_map<unsigned long long, int> edgeUse;
+    for (size_t t = 0; t < triCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = tris[t * 3 + k], b = tris[t * 3 + (k + 1) % 3];
+            edgeUse[((unsigned long long)glm::min(a, b) << 32) | glm::max(a, b)]++;
+        }
+    }
+    for (const auto& edge : edgeUse) {
+        if (edge.second == 1) {
+            locked[edge.first >> 32] = 1;
+            locked[edge.first & 0xFFFFFFFF] = 1;
+        }
+    }
+
+    struct Collapse {
+        double cost;
+        unsigned int from, to;
+        unsigned int stampFrom, stampTo;
+        bool operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+    std::vector<unsigned int> stamp(vertexCount, 0);
+
+    auto collapseCost = [&](unsigned int from, unsigned int to) {
+        Quadric q = quadrics[from];
+        q.add(quadrics[to]);
+        double cost = q.evaluate(positions[to]);
+        if (hasSkin) {
+            double lengthSq = glm::dot(glm::dvec3(positions[from] - positions[to]), glm::dvec3(positions[from] - positions[to]));
+            cost += skinDifference(joints, weights, from, to) * lengthSq * q.area;
+        }
+        return glm::max(cost, 0.0);
+    };
+    auto pushEdge = [&](unsigned int a, unsigned int b) {
+        if (locked[a] && locked[b]) return;
+        double costAB = locked[a] ? 1e300 : collapseCost(a, b);
+        double costBA = locked[b] ? 1e300 : collapseCost(b, a);
+        if (costAB <= costBA) heap.push({costAB, a, b, stamp[a], stamp[b]});
+        else heap.push({costBA, b, a, stamp[b], stamp[a]});
+    };
+    for (size_t t = 0; t < triCount; t++) {
+        for (int k = 0; k < 3; k++) pushEdge(tris[t * 3 + k], tris[t * 3 + (k + 1) % 3]);
+    }
+
+    // Moving 'from' onto 'to' must not flip or collapse any surviving triangle
+    auto collapseFlips = [&](unsigned int from, unsigned int to) {
+        for (unsigned int t : vertexTris[from]) {
+            if (!triAlive[t]) continue;
+            const unsigned int* tri = &tris[t * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++) {
+                p[k] = positions[tri[k]];
+                q[k] = (tri[k] == from) ? positions[to] : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 0.0f) return true;
+        }
+        return false;
+    };
+
+    std::vector<LodLevel> levels;
+    size_t liveTris = triCount;
+    double maxError = 0.0;
+    for (float ratio : targetRatios) {
+        size_t target = (size_t)(triCount * ratio);
+        while (liveTris > target && !heap.empty()) {
+            Collapse c = heap.top();
+            heap.pop();
+            if (!vertexAlive[c.from] || !vertexAlive[c.to] || stamp[c.from] != c.stampFrom || stamp[c.to] != c.stampTo) continue;
+            if (collapseFlips(c.from, c.to)) continue;
+
+            quadrics[c.to].add(quadrics[c.from]);
+            vertexAlive[c.from] = 0;
+            stamp[c.to]++;
+            for (unsigned int t : vertexTris[c.from]) {
+                if (!triAlive[t]) continue;
+                unsigned int* tri = &tris[t * 3];
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                    triAlive[t] = 0;
+                    liveTris--;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++) {
+                    if (tri[k] == c.from) tri[k] = c.to;
+                }
+                vertexTris[c.to].push_back(t);
+            }
+            vertexTris[c.from].clear();
+            for (unsigned int t : vertexTris[c.to]) {
+                if (!triAlive[t]) continue;
+                for (int k = 0; k < 3; k++) {
+                    if (tris[t * 3 + k] != c.to) pushEdge(c.to, tris[t * 3 + k]);
+                }
+            }
+            maxError = glm::max(maxError, c.cost / glm::max(quadrics[c.to].area, 1e-12));
+        }
+
+        LodLevel level;
+        for (size_t t = 0; t < triCount; t++) {
+            if (!triAlive[t]) continue;
+            level.indices.insert(level.indices.end(), &tris[t * 3], &tris[t * 3] + 3);
+        }
+        level.error = (float)sqrt(maxError);
+        // Stop once simplification stalls (everything left is locked or would flip)
+        size_t previous = levels.empty() ? indices.size() : levels.back().indices.size();
+        if (level.indices.size() > previous * 0.9) break;
+        levels.push_back(level);
+    }
+    return levels;
+}
+
+// Index Buffer Optimization
+// Exported index order is whatever the modelling tool left behind. At load the
+// triangles are reordered for the post-transform vertex cache (Tipsify), the
+// resulting clusters are sorted outside-in to cut overdraw, and vertices are
+// renumbered in first-use order so fetches walk the vertex buffer linearly.
+const int VERTEX_CACHE_SIZE = 16;
+const float OVERDRAW_ACMR_THRESHOLD = 1.05f; // allowed cache cost of cluster sorting
+
+// Average cache miss ratio (transforms per triangle) of a FIFO cache, and the
+// average transform to vertex ratio over the vertices the indices reference
+float vertexCacheAcmr(const std::vector<unsigned int>& indices, size_t vertexCount, float* atvr = nullptr) {
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<char> used(vertexCount, 0);
+    unsigned int time = VERTEX_CACHE_SIZE + 1;
+    size_t transforms = 0, unique = 0;
+    for (unsigned int v : indices) {
+        if (time - cacheTime[v] > (unsigned int)VERTEX_CACHE_SIZE) {
+            cacheTime[v] = time++;
+            transforms++;
+        }
+        if (!used[v]) {
+            used[v] = 1;
+            unique++;
+        }
+    }
+    if (atvr) *atvr = unique ? (float)transforms / unique : 0.0f;
+    return indices.empty() ? 0.0f : (float)transforms / (indices.size() / 3);
+}
+
+// Tipsify (Sander et al. 2007). clusterStarts receives the triangle index of
+// every point where the walk had to restart away from the cache.
+std::vector<unsigned int> optimizeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, std::vector<size_t>& clusterStarts) {
+    size_t triCount = indices.size() / 3;
+    std::vector<unsigned int> offsets(vertexCount + 1, 0), adjacency(indices.size());
+    std::vector<int> liveCount(vertexCount, 0);
+    for (unsigned int v : indices) liveCount[v]++;
+    for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + liveCount[v];
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triCount; t++) {
+        for (int k = 0; k < 3; k++) adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<char> emitted(triCount, 0);
+    std::vector<unsigned int> deadEnd, candidates;
+    unsigned int time = VERTEX_CACHE_SIZE + 1;
+    size_t scan = 0;
+    clusterStarts.assign(1, 0);
+
+    int current = triCount ? (int)indices[0] : -1;
+    while (current >= 0) {
+        candidates.clear();
+        for (unsigned int a = offsets[current]; a < offsets[current + 1]; a++) {
+            unsigned int t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = 1;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveCount[v]--;
+                if (time - cacheTime[v] > (unsigned int)VERTEX_CACHE_SIZE) cacheTime[v] = time++;
+            }
+        }
+
+        // Prefer a fanned-out vertex that will still be in the cache once its triangles are emitted
+        int best = -1, bestPriority = -1;
+        for (unsigned int v : candidates) {
+            if (liveCount[v] <= 0) continue;
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * liveCount[v] <= (unsigned int)VERTEX_CACHE_SIZE) priority = time - cacheTime[v];
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = (int)v;
+            }
+        }
+        if (best < 0) {
+            while (!deadEnd.empty() && best < 0) {
+                unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveCount[v] > 0) best = (int)v;
+            }
+            while (best < 0 && scan < vertexCount) {
+                if (liveCount[scan] > 0) best = (int)scan;
+                scan++;
+            }
+            if (best >= 0) clusterStarts.push_back(output.size() / 3);
+        }
+        current = best;
+    }
+    return output;
+}
+
+// Sorts the cache clusters so outward-facing ones draw first (Sander et al.'s
+// fast overdraw heuristic). Tiny clusters are merged with the next one so the
+// sort doesn't undo the cache ordering, and the result is dropped if it still
+// costs more than OVERDRAW_ACMR_THRESHOLD times the original ACMR.
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<size_t>& clusterStarts, const std::vector<glm::vec3>& positions) {
+    const size_t MIN_CLUSTER_TRIANGLES = 64;
+    size_t triCount = indices.size() / 3;
+    std::vector<size_t> starts;
+    for (size_t start : clusterStarts) {
+        if (starts.empty() || start - starts.back() >= MIN_CLUSTER_TRIANGLES) starts.push_back(start);
+    }
+    if (starts.size() < 2) return;
+
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<float> sortKey(starts.size());
+    std::vector<glm::vec4> clusterCenter(starts.size());
+    std::vector<glm::vec3> clusterNormal(starts.size());
+    for (size_t c = 0; c < starts.size(); c++) {
+        size_t end = (c + 1 < starts.size()) ? starts[c + 1] : triCount;
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = starts[c]; t < end; t++) {
+            glm::vec3 p0 = positions[indices[t * 3]], p1 = positions[indices[t * 3 + 1]], p2 = positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            center += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        meshCenter += center;
+        meshArea += area;
+        clusterCenter[c] = glm::vec4(center / glm::max(area, 1e-12f), area);
+        clusterNormal[c] = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f);
+    }
+    meshCenter /= glm::max(meshArea, 1e-12f);
+    for (size_t c = 0; c < starts.size(); c++) sortKey[c] = glm::dot(glm::vec3(clusterCenter[c]) - meshCenter, clusterNormal[c]);
+
+    std::vector<size_t> order(starts.size());
+    for (size_t c = 0; c < order.size(); c++) order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (size_t c : order) {
+        size_t end = (c + 1 < starts.size()) ? starts[c + 1] : triCount;
+        sorted.insert(sorted.end(), indices.begin() + starts[c] * 3, indices.begin() + end * 3);
+    }
+    if (vertexCacheAcmr(sorted, positions.size()) <= vertexCacheAcmr(indices, positions.size()) * OVERDRAW_ACMR_THRESHOLD) {
+        indices.swap(sorted);
+    }
+}
+
+// Renumbers vertices in order of first use across all index lists and returns
+// the old-to-new remap; vertices no list references keep their relative order at the end
+std::vector<unsigned int> optimizeVertexFetch(const std::vector<std::vector<unsigned int>*>& indexLists, size_t vertexCount) {
+    const unsigned int UNUSED = 0xFFFFFFFF;
+    std::vector<unsigned int> remap(vertexCount, UNUSED);
+    unsigned int next = 0;
+    for (std::vector<unsigned int>* list : indexLists) {
+        for (unsigned int v : *list) {
+            if (remap[v] == UNUSED) remap[v] = next++;
+        }
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        if (remap[v] == UNUSED) remap[v] = next++;
+    }
+    for (std::vector<unsigned int>* list : indexLists) {
+        for (unsigned int& v : *list) v = remap[v];
+    }
+    return remap;
+}
+
+// Applies a remap from optimizeVertexFetch to a per-vertex stream of 'stride' elements
+template <typename T>
+void remapVertexStream(std::vector<T>& stream, const std::vector<unsigned int>& remap, size_t stride = 1) {
+    if (stream.empty()) return;
+    std::vector<T> remapped(stream.size());
+    for (size_t v = 0; v < remap.size(); v++) {
+        for (size_t s = 0; s < stride; s++) remapped[remap[v] * stride + s] = stream[v * stride + s];
+    }
+    stream.swap(remapped);
+}
+
+// Coarsest LOD whose error, projected at this distance, stays under LOD_PIXEL_ERROR pixels
+const MeshLod* selectLod(const SubMesh& mesh, float scale, float distance, float fovY, float viewportHeight) {
+    if (mesh.lods.empty()) return nullptr;
+    float pixelsPerUnit = (viewportHeight * 0.5f) / (tanf(fovY * 0.5f) * glm::max(distance - mesh.boundsRadius * scale, 0.01f));
+    for (int i = (int)mesh.lods.size() - 1; i > 0; i--) {
+        if (mesh.lods[i].error * scale * pixelsPerUnit < LOD_PIXEL_ERROR) return &mesh.lods[i];
+    }
+    return &mesh.lods[0];
+}
+
+// Loads a GLTF file as one merged model. With no node list every mesh is taken
+// in its own space (the bird: the skin places it); otherwise only the listed
+// nodes' meshes are loaded, baked with their world transforms (rigid meshes).
+GLTFModel loadGLTFModel(const std::string& path, Skeleton& skeleton, const std::vector<int>& nodes = {}) {
+    GLTFModel model;
+
+    std::ifstream f(path);
+    if (!f) {
+        std::cout << "Failed to load GLTF: " << path << std::endl;
+        return model;
+    }
+    json j;
+    f >> j;
+
+    std::string directory = path.substr(0, path.find_last_of("/\\")) + "/";
+    std::string name = path.substr(directory.size());
+    std::vector<unsigned char> binData;
+    if (!loadGLTFBuffers(j, path, binData)) return model;
+
+    // Meshes to load and the transform baked into each
+    std::vector<std::pair<int, glm::mat4>> meshInstances;
+    if (nodes.empty()) {
+        for (int meshIdx = 0; meshIdx < (int)j["meshes"].size(); meshIdx++) meshInstances.push_back({meshIdx, glm::mat4(1.0f)});
+    } else {
+        SceneHierarchy hierarchy = loadSceneHierarchy(j);
+        hierarchy.updateWorld();
+        for (int nodeIdx : nodes) {
+            const json& node = j["nodes"][nodeIdx];
+            if (node.contains("mesh")) meshInstances.push_back({(int)node["mesh"], hierarchy.world[hierarchy.sortedIndex[nodeIdx]]});
+        }
+    }
+
+    // Skin used by each mesh (first node that instances it); only the first skin drives the palette
+    std::vector<int> meshSkin(j["meshes"].size(), -1);
+    for (const auto& node : j["nodes"]) {
+        if (node.contains("mesh") && node.contains("skin")) meshSkin[(int)node["mesh"]] = node["skin"];
+    }
+    int skinIdx = -1;
+    for (int s : meshSkin) {
+        if (s >= 0) { skinIdx = s; break; }
+    }
+
+    std::vector<int> slotOfJoint; // skin joint -> palette slot
+    if (skinIdx >= 0) {
+        loadSkeletonNodes(j, skeleton);
+        slotOfJoint.assign(j["skins"][skinIdx]["joints"].size(), -1);
+    }
+
+    // Whole-model streams; submesh indices stay local and are offset by baseVertex at draw time
+    std::vector<ModelVertex> modelVertices;
+    std::vector<unsigned int> modelIndices;
+    // Full-detail vertex cache cost before and after optimization, summed over
+    // primitives by triangle (ACMR) and vertex (ATVR) count for the summary
+    double acmrBefore = 0.0, acmrAfter = 0.0, atvrBefore = 0.0, atvrAfter = 0.0;
+    size_t cacheTriangles = 0, cacheVertices = 0;
+    std::vector<int> materialSlot(j.contains("materials") ? j["materials"].size() : 0, -1);
+    CpuSkin& modelSkin = model.cpuSkin;
+    model.materials.push_back(glm::vec4(1.0f));
+    model.materialImages.push_back("");
+
+    for (const auto& meshInstance : meshInstances) {
+        int meshIdx = meshInstance.first;
+        const glm::mat4& transform = meshInstance.second;
+        bool baked = transform != glm::mat4(1.0f);
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        bool mirrored = glm::determinant(glm::mat3(transform)) < 0.0f;
+        const auto& mesh = j["meshes"][meshIdx];
+        if (mesh.contains("name") && mesh["name"] == "Cube.001") continue;
+        for (const auto& primitive : mesh["primitives"]) {
+            // Indices
+            int indicesIdx = primitive["indices"];
+            auto& indicesAccessor = j["accessors"][indicesIdx];
+            int indicesOffset = accessorOffset(j, indicesAccessor);
+            int indexCount = indicesAccessor["count"];
+            int componentType = indicesAccessor["componentType"];
+
+            // Attributes
+            auto& attributes = primitive["attributes"];
+            auto& posAccessor = j["accessors"][(int)attributes["POSITION"]];
+            AccessorReader posReader = accessorReader(j, binData, posAccessor);
+            AccessorReader normReader = accessorReader(j, binData, j["accessors"][(int)attributes["NORMAL"]]);
+            bool hasUV = attributes.contains("TEXCOORD_0");
+            AccessorReader uvReader = hasUV ? accessorReader(j, binData, j["accessors"][(int)attributes["TEXCOORD_0"]]) : AccessorReader();
+
+            int vertexCount = posAccessor["count"];
+            std::vector<ModelVertex> vertices(vertexCount);
+            std::vector<glm::vec3> positions(vertexCount), normals(vertexCount);
+            for (int i = 0; i < vertexCount; i++) {
+                glm::vec2 uv(0.0f);
+                positions[i] = glm::vec3(posReader.read(i, 0), posReader.read(i, 1), posReader.read(i, 2));
+                normals[i] = glm::vec3(normReader.read(i, 0), normReader.read(i, 1), normReader.read(i, 2));
+                if (normReader.componentType != 5126 && glm::length(normals[i]) > 0.0f) normals[i] = glm::normalize(normals[i]);
+                if (hasUV) uv = glm::vec2(uvReader.read(i, 0), uvReader.read(i, 1));
+                if (baked) {
+                    positions[i] = glm::vec3(transform * glm::vec4(positions[i], 1.0f));
+                    normals[i] = glm::normalize(normalMatrix * normals[i]);
+                }
+                // Images load flipped; kept below 1.0 since the scene shader wraps texture coordinates with fract()
+                uv = glm::clamp(glm::vec2(uv.x, 1.0f - uv.y), 0.0f, 0.9999f);
+                memset(&vertices[i], 0, sizeof(ModelVertex));
+                vertices[i].base = packVertex(positions[i], normals[i], uv);
+            }
+
+            // Material slot, shared by every primitive using the same GLTF material
+            int material = 0;
+            if (primitive.contains("material")) {
+                int matIdx = primitive["material"];
+                if (materialSlot[matIdx] < 0 && (int)model.materials.size() < MAX_MATERIALS) {
+                    const json& pbr = j["materials"][matIdx].value("pbrMetallicRoughness", json::object());
+                    glm::vec4 color(1.0f);
+                    if (pbr.contains("baseColorFactor")) {
+                        for (int c = 0; c < 4; c++) color[c] = pbr["baseColorFactor"][c];
+                    }
+                    std::string image;
+                    if (pbr.contains("baseColorTexture")) {
+                        int source = j["textures"][(int)pbr["baseColorTexture"]["index"]]["source"];
+                        image = directory + urlDecode(j["images"][source]["uri"]);
+                    }
+                    materialSlot[matIdx] = (int)model.materials.size();
+                    model.materials.push_back(color);
+                    model.materialImages.push_back(image);
+                }
+                material = glm::max(materialSlot[matIdx], 0);
+            }
+            for (ModelVertex& v : vertices) v.material = (unsigned char)material;
+
+            // Skin: joints remapped to palette slots, weights renormalized to unorm8
+            CpuSkin cpuSkin;
+            bool primitiveSkinned = meshSkin[meshIdx] == skinIdx && skinIdx >= 0 && attributes.contains("JOINTS_0") && attributes.contains("WEIGHTS_0");
+            if (primitiveSkinned) {
+                auto& jointAccessor = j["accessors"][(int)attributes["JOINTS_0"]];
+                auto& weightAccessor = j["accessors"][(int)attributes["WEIGHTS_0"]];
+                AccessorReader jointReader = accessorReader(j, binData, jointAccessor);
+                AccessorReader weightReader = accessorReader(j, binData, weightAccessor);
+
+                cpuSkin.joints.resize(vertexCount * 4);
+                cpuSkin.weights.resize(vertexCount);
+                bool overflow = false;
+                for (int i = 0; i < vertexCount; i++) {
+                    glm::vec4 weights;
+                    for (int c = 0; c < 4; c++) weights[c] = weightReader.read(i, c);
+                    float total = weights.x + weights.y + weights.z + weights.w;
+                    weights = (total > 0.0f) ? weights / total : glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+
+                    for (int c = 0; c < 4; c++) {
+                        int joint = (int)jointReader.read(i, c);
+                        int& slot = slotOfJoint[joint];
+                        if (weights[c] > 0.0f && slot < 0) {
+                            if ((int)skeleton.jointNodes.size() < MAX_JOINTS) {
+                                slot = (int)skeleton.jointNodes.size();
+                                skeleton.jointNodes.push_back(skeleton.nodes.sortedIndex[(int)j["skins"][skinIdx]["joints"][joint]]);
+                            } else {
+                                overflow = true;
+                            }
+                        }
+                        int usedSlot = (weights[c] > 0.0f && slot >= 0) ? slot : 0;
+                        vertices[i].joints[c] = (unsigned char)usedSlot;
+                        vertices[i].weights[c] = (unsigned char)(weights[c] * 255.0f + 0.5f);
+                        cpuSkin.joints[i * 4 + c] = (unsigned char)usedSlot;
+                    }
+                    cpuSkin.weights[i] = weights;
+                }
+                if (overflow) std::cout << name << " skin uses more than " << MAX_JOINTS << " joints, extra joints ignored" << std::endl;
+                model.skinned = true;
+            } else {
+                // Rigid primitive: zero weights leave it in the bind pose on both skinning paths
+                cpuSkin.joints.assign(vertexCount * 4, 0);
+                cpuSkin.weights.assign(vertexCount, glm::vec4(0.0f));
+            }
+            cpuSkin.positions.resize(vertexCount);
+            cpuSkin.normals.resize(vertexCount);
+            for (int i = 0; i < vertexCount; i++) {
+                cpuSkin.positions[i] = glm::vec4(positions[i], 1.0f);
+                cpuSkin.normals[i] = glm::vec4(normals[i], 0.0f);
+            }
+
+            // LOD chain appended after the full-detail indices in the same element buffer
+            std::vector<unsigned int> baseIndices(indexCount);
+            for (int i = 0; i < indexCount; i++) baseIndices[i] = readAccessorInt(binData, indicesOffset, componentType, 1, i, 0);
+            if (mirrored) {
+                for (int i = 0; i + 2 < indexCount; i += 3) std::swap(baseIndices[i + 1], baseIndices[i + 2]);
+            }
+            float atvr;
+            acmrBefore += vertexCacheAcmr(baseIndices, vertexCount, &atvr) * (indexCount / 3);
+            atvrBefore += atvr * vertexCount;
+            std::vector<size_t> clusterStarts;
+            baseIndices = optimizeVertexCache(baseIndices, vertexCount, clusterStarts);
+            optimizeOverdraw(baseIndices, clusterStarts, positions);
+            acmrAfter += vertexCacheAcmr(baseIndices, vertexCount, &atvr) * (indexCount / 3);
+            atvrAfter += atvr * vertexCount;
+            cacheTriangles += indexCount / 3;
+            cacheVertices += vertexCount;
+
+            std::vector<LodLevel> levels;
+            if (indexCount >= LOD_MIN_INDICES) {
+                levels = buildLodChain(positions, cpuSkin.joints, cpuSkin.weights, baseIndices, {0.5f, 0.25f, 0.125f});
+            }
+            std::vector<std::vector<unsigned int>*> indexLists = {&baseIndices};
+            for (LodLevel& level : levels) {
+                std::vector<size_t> levelClusters;
+                level.indices = optimizeVertexCache(level.indices, vertexCount, levelClusters);
+                optimizeOverdraw(level.indices, levelClusters, positions);
+                indexLists.push_back(&level.indices);
+            }
+
+            // Vertex fetch order follows the full-detail draw; every stream is remapped to match
+            std::vector<unsigned int> remap = optimizeVertexFetch(indexLists, vertexCount);
+            remapVertexStream(vertices, remap);
+            remapVertexStream(positions, remap);
+            remapVertexStream(cpuSkin.positions, remap);
+            remapVertexStream(cpuSkin.normals, remap);
+            remapVertexStream(cpuSkin.weights, remap);
+            remapVertexStream(cpuSkin.joints, remap, 4);
+
+            SubMesh subMesh;
+            subMesh.baseVertex = (int)modelVertices.size();
+            subMesh.vertexCount = vertexCount;
+            subMesh.material = material;
+            subMesh.boundsRadius = 0.0f;
+            for (const glm::vec3& p : positions) subMesh.boundsRadius = glm::max(subMesh.boundsRadius, glm::length(p));
+            if (!baked && posReader.componentType == 5126 && posAccessor.contains("min") && posAccessor.contains("max")) {
+                subMesh.boundsMin = glm::vec3(posAccessor["min"][0], posAccessor["min"][1], posAccessor["min"][2]);
+                subMesh.boundsMax = glm::vec3(posAccessor["max"][0], posAccessor["max"][1], posAccessor["max"][2]);
+            } else {
+                subMesh.boundsMin = subMesh.boundsMax = positions.empty() ? glm::vec3(0.0f) : positions[0];
+                for (const glm::vec3& p : positions) {
+                    subMesh.boundsMin = glm::min(subMesh.boundsMin, p);
+                    subMesh.boundsMax = glm::max(subMesh.boundsMax, p);
+                }
+            }
+            if (primitiveSkinned) {
+                // Animated joints move vertices outside the bind pose; pad by half the largest extent
+                glm::vec3 size = subMesh.boundsMax - subMesh.boundsMin;
+                float padding = 0.5f * glm::max(size.x, glm::max(size.y, size.z));
+                subMesh.boundsMin -= glm::vec3(padding);
+                subMesh.boundsMax += glm::vec3(padding);
+            }
+            subMesh.lods.push_back({(int)modelIndices.size(), indexCount, 0.0f});
+            modelIndices.insert(modelIndices.end(), baseIndices.begin(), baseIndices.end());
+            for (const LodLevel& level : levels) {
+                subMesh.lods.push_back({(int)modelIndices.size(), (int)level.indices.size(), level.error});
+                modelIndices.insert(modelIndices.end(), level.indices.begin(), level.indices.end());
+            }
+            model.subMeshes.push_back(subMesh);
+
+            modelVertices.insert(modelVertices.end(), vertices.begin(), vertices.end());
+            modelSkin.positions.insert(modelSkin.positions.end(), cpuSkin.positions.begin(), cpuSkin.positions.end());
+            modelSkin.normals.insert(modelSkin.normals.end(), cpuSkin.normals.begin(), cpuSkin.normals.end());
+            modelSkin.joints.insert(modelSkin.joints.end(), cpuSkin.joints.begin(), cpuSkin.joints.end());
+            modelSkin.weights.insert(modelSkin.weights.end(), cpuSkin.weights.begin(), cpuSkin.weights.end());
+        }
+    }
+
+    // Inverse bind matrices for the slots in use
+    if (skinIdx >= 0) {
+        const auto& skin = j["skins"][skinIdx];
+        int ibmOffset = skin.contains("inverseBindMatrices") ? accessorOffset(j, j["accessors"][(int)skin["inverseBindMatrices"]]) : -1;
+        skeleton.inverseBind.resize(skeleton.jointNodes.size());
+        for (int joint = 0; joint < (int)slotOfJoint.size(); joint++) {
+            if (slotOfJoint[joint] < 0) continue;
+            glm::mat4 ibm(1.0f);
+            if (ibmOffset >= 0) memcpy(glm::value_ptr(ibm), &binData[ibmOffset + joint * 64], 64);
+            skeleton.inverseBind[slotOfJoint[joint]] = ibm;
+        }
+        skeleton.palette.resize(skeleton.jointNodes.size());
+        findWings(j, skeleton);
+        loadAnimations(j, binData, skeleton, name);
+    }
+
+    // 16-bit indices unless a single submesh is too big for them; LOD offsets become bytes
+    bool shortIndices = true;
+    for (const SubMesh& subMesh : model.subMeshes) shortIndices = shortIndices && subMesh.vertexCount <= 65536;
+    model.indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    int indexSize = shortIndices ? 2 : 4;
+    for (SubMesh& subMesh : model.subMeshes) {
+        for (MeshLod& lod : subMesh.lods) lod.indexOffset *= indexSize;
+    }
+    if (!model.skinned) model.cpuSkin = CpuSkin();
+    if (shortIndices) {
+        std::vector<unsigned short> indices16(modelIndices.begin(), modelIndices.end());
+        createModelBuffers(model, modelVertices, indices16.data(), indices16.size() * 2);
+    } else {
+        createModelBuffers(model, modelVertices, modelIndices.data(), modelIndices.size() * 4);
+    }
+    std::cout << name << ": " << model.subMeshes.size() << " submeshes, " << modelVertices.size() << " vertices, "
+              << modelIndices.size() << " indices (all LODs), " << model.materials.size() - 1 << " materials";
+    if (cacheTriangles > 0) {
+        std::cout << ", ACMR " << acmrBefore / cacheTriangles << " -> " << acmrAfter / cacheTriangles
+                  << ", ATVR " << atvrBefore / cacheVertices << " -> " << atvrAfter / cacheVertices;
+    }
+    std::cout << std::endl;
+    return model;
+}
+
+// Static batching: every mesh instance in the GLTF scene is baked into world
+// space with its node's full transform (parents included) and appended into one
+// vertex and index buffer, so the whole scene is a single indexed draw.
+// Materials aren't kept; the caller supplies one texture for the batch.
+GLTFMesh loadStaticBatch(const std::string& path, std::string* imagePath) {
+    GLTFMesh mesh = {};
+    std::ifstream f(path);
+    if (!f) {
+        std::cout << "Failed to load GLTF: " << path << std::endl;
+        return mesh;
+    }
+    json j;
+    f >> j;
+
+    std::string directory = path.substr(0, path.find_last_of("/\\")) + "/";
+    std::vector<unsigned char> binData;
+    if (!loadGLTFBuffers(j, path, binData)) return mesh;
+    if (imagePath && j.contains("images") && !j["images"].empty()) *imagePath = directory + urlDecode(j["images"][0]["uri"]);
+
+    std::vector<CompactVertex> vertices;
+    std::vector<unsigned int> indices;
+    int instances = 0;
+
+    // Every node under the default scene's roots; each root's subtree is a contiguous range
+    SceneHierarchy hierarchy = loadSceneHierarchy(j);
+    hierarchy.updateWorld();
+    std::vector<int> sceneNodes;
+    int sceneIdx = j.contains("scene") ? (int)j["scene"] : 0;
+    for (const auto& root : j["scenes"][sceneIdx]["nodes"]) {
+        int first = hierarchy.sortedIndex[(int)root];
+        for (int i = first; i < hierarchy.subtreeEnd[first]; i++) sceneNodes.push_back(i);
+    }
+    for (int sorted : sceneNodes) {
+        const json& node = j["nodes"][hierarchy.gltfNode[sorted]];
+        if (!node.contains("mesh")) continue;
+        const glm::mat4& world = hierarchy.world[sorted];
+
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+        bool mirrored = glm::determinant(glm::mat3(world)) < 0.0f; // negative scale flips the winding
+        for (const auto& primitive : j["meshes"][(int)node["mesh"]]["primitives"]) {
+            if (primitive.contains("mode") && (int)primitive["mode"] != 4) continue; // triangles only
+            const auto& attributes = primitive["attributes"];
+            const json& posAcc = j["accessors"][(int)attributes["POSITION"]];
+            AccessorReader posReader = accessorReader(j, binData, posAcc);
+            int count = posAcc["count"];
+            bool hasNormal = attributes.contains("NORMAL"), hasUV = attributes.contains("TEXCOORD_0");
+            AccessorReader normalReader = hasNormal ? accessorReader(j, binData, j["accessors"][(int)attributes["NORMAL"]]) : AccessorReader();
+            AccessorReader uvReader = hasUV ? accessorReader(j, binData, j["accessors"][(int)attributes["TEXCOORD_0"]]) : AccessorReader();
+
+            unsigned int base = (unsigned int)vertices.size();
+            for (int i = 0; i < count; i++) {
+                glm::vec3 position(posReader.read(i, 0), posReader.read(i, 1), posReader.read(i, 2));
+                glm::vec3 normal(0.0f, 0.0f, 1.0f);
+                if (hasNormal) normal = glm::vec3(normalReader.read(i, 0), normalReader.read(i, 1), normalReader.read(i, 2));
+                glm::vec2 uv(0.0f);
+                if (hasUV) uv = glm::vec2(uvReader.read(i, 0), uvReader.read(i, 1));
+                // Images load flipped; kept below 1.0 since the scene shader wraps texture coordinates with fract()
+                uv = glm::clamp(glm::vec2(uv.x, 1.0f - uv.y), 0.0f, 0.9999f);
+                vertices.push_back(packVertex(glm::vec3(world * glm::vec4(position, 1.0f)), glm::normalize(normalMatrix * normal), uv));
+            }
+
+            if (primitive.contains("indices")) {
+                const json& idxAcc = j["accessors"][(int)primitive["indices"]];
+                int idxOffset = accessorOffset(j, idxAcc);
+                int idxType = idxAcc["componentType"];
+                int idxCount = idxAcc["count"];
+                for (int i = 0; i + 2 < idxCount; i += 3) {
+                    unsigned int a = readAccessorInt(binData, idxOffset, idxType, 1, i, 0);
+                    unsigned int b = readAccessorInt(binData, idxOffset, idxType, 1, i + 1, 0);
+                    unsigned int c = readAccessorInt(binData, idxOffset, idxType, 1, i + 2, 0);
+                    if (mirrored) std::swap(b, c);
+                    indices.insert(indices.end(), {base + a, base + b, base + c});
+                }
+            } else {
+                for (int i = 0; i + 2 < count; i += 3) {
+                    indices.insert(indices.end(), {base + i, base + (mirrored ? i + 2 : i + 1), base + (mirrored ? i + 1 : i + 2)});
+                }
+            }
+        }
+        instances++;
+    }
+    if (indices.empty()) return mesh;
+
+    if (vertices.size() <= 65536) {
+        std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+        mesh = createCompactMesh(vertices, shortIndices.data(), (int)shortIndices.size(), GL_UNSIGNED_SHORT);
+    } else {
+        mesh = createCompactMesh(vertices, indices.data(), (int)indices.size(), GL_UNSIGNED_INT);
+    }
+    std::cout << "Static batch " << path << ": " << instances << " mesh instances, " << vertices.size() << " vertices, "
+              << indices.size() / 3 << " triangles in one draw" << std::endl;
+    return mesh;
+}
+
+// Asset Cooking
+// --cook file.gltf writes file.meshopt.gltf and .bin beside it. Attributes are
+// quantized per KHR_mesh_quantization: int16 positions with the dequantization
+// folded into the mesh's nodes, int8 normals, unorm16 UVs and unorm8 weights.
+// Skinned meshes keep float positions, since their dequantization would have
+// to go into the inverse bind matrices and the loader packs mesh-space
+// positions to half floats. Every mesh stream is then compressed with
+// EXT_meshopt_compression; everything else (inverse bind matrices, animation)
+// is copied as is. The game loads the cooked file instead when it exists and
+// is not older than the source .gltf and its .bin.
+const long COOKED_AGE_TOLERANCE = 2; // seconds; a checkout writes files in no particular order
+
+std::string cookedAssetPath(const std::string& path) {
+    std::string stem = path.substr(0, path.find_last_of('.'));
+    std::string cooked = stem + ".meshopt.gltf";
+    struct stat cookedInfo, sourceInfo;
+    if (stat(cooked.c_str(), &cookedInfo) != 0) return path;
+    // The models here all load their buffer from the .bin named after them
+    for (const std::string& source : {path, stem + ".bin"}) {
+        if (stat(source.c_str(), &sourceInfo) != 0) continue;
+        if ((long)(sourceInfo.st_mtime - cookedInfo.st_mtime) > COOKED_AGE_TOLERANCE) {
+            std::cout << cooked << " is older than " << source << ", loading the source instead (rebuild it with --cook)" << std::endl;
+            return path;
+        }
+    }
+    return cooked;
+}
+
+std::string urlEncode(const std::string& text) {
+    std::string result;
+    for (unsigned char ch : text) {
+        if (isalnum(ch) || ch == '-' || ch == '_' || ch == '.' || ch == '~') {
+            result += (char)ch;
+        } else {
+            char escaped[4];
+            snprintf(escaped, sizeof(escaped), "%%%02X", ch);
+            result += escaped;
+        }
+    }
+    return result;
+}
+
+bool cookGLTF(const std::string& path) {
+    std::ifstream f(path);
+    if (!f) {
+        std::cout << "Failed to load GLTF: " << path << std::endl;
+        return false;
+    }
+    json j;
+    f >> j;
+    std::vector<unsigned char> bin;
+    if (!loadGLTFBuffers(j, path, bin)) return false;
+    size_t sourceBinBytes = bin.size();
+
+    // What each accessor holds; accessors no triangle primitive uses are copied raw
+    int accessorCount = j.contains("accessors") ? (int)j["accessors"].size() : 0;
+    int meshCount = j.contains("meshes") ? (int)j["meshes"].size() : 0;
+    std::vector<std::string> semantic(accessorCount);
+    std::vector<int> accessorMesh(accessorCount, -1);
+    for (int m = 0; m < meshCount; m++) {
+        for (const auto& primitive : j["meshes"][m]["primitives"]) {
+            if (primitive.contains("targets")) {
+                std::cout << "Cannot cook " << path << ": morph targets aren't supported" << std::endl;
+                return false;
+            }
+            if (primitive.contains("mode") && (int)primitive["mode"] != 4) continue;
+            for (const auto& attribute : primitive["attributes"].items()) {
+                semantic[(int)attribute.value()] = attribute.key();
+                accessorMesh[(int)attribute.value()] = m;
+            }
+            if (primitive.contains("indices")) semantic[(int)primitive["indices"]] = "INDICES";
+        }
+    }
+    for (int a = 0; a < accessorCount; a++) {
+        if (j["accessors"][a].contains("sparse")) {
+            std::cout << "Cannot cook " << path << ": sparse accessors aren't supported" << std::endl;
+            return false;
+        }
+    }
+
+    // Positions of rigid meshes become int16 around the mesh's bounds center;
+    // a node with children can't take the dequantization scale, so its mesh stays float
+    std::vector<bool> quantizePositions(meshCount, true);
+    for (const auto& node : j["nodes"]) {
+        if (node.contains("mesh") && (node.contains("skin") || node.contains("children"))) quantizePositions[(int)node["mesh"]] = false;
+    }
+    std::vector<glm::vec4> dequantize(meshCount, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // center, scale
+    for (int m = 0; m < meshCount; m++) {
+        if (!quantizePositions[m]) continue;
+        glm::vec3 lo(1e30f), hi(-1e30f);
+        for (const auto& primitive : j["meshes"][m]["primitives"]) {
+            if (!primitive["attributes"].contains("POSITION")) continue;
+            const json& accessor = j["accessors"][(int)primitive["attributes"]["POSITION"]];
+            AccessorReader reader = accessorReader(j, bin, accessor);
+            for (int i = 0; i < (int)accessor["count"]; i++) {
+                glm::vec3 p(reader.read(i, 0), reader.read(i, 1), reader.read(i, 2));
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+            }
+        }
+        if (lo.x > hi.x) continue;
+        glm::vec3 halfSize = (hi - lo) * 0.5f;
+        float extent = glm::max(halfSize.x, glm::max(halfSize.y, halfSize.z));
+        dequantize[m] = glm::vec4((lo + hi) * 0.5f, glm::max(extent, 1e-6f) / 32767.0f);
+    }
+
+    std::vector<unsigned char> packed; // the cooked .bin: compressed streams and raw data
+    size_t fallbackBytes = 0;          // size of the uncompressed views, which only exist after decoding
+    size_t meshBytesBefore = 0, meshBytesQuantized = 0, meshBytesCompressed = 0;
+    json views = json::array();
+    for (int a = 0; a < accessorCount; a++) {
+        json& accessor = j["accessors"][a];
+        if (!accessor.contains("bufferView")) continue;
+        AccessorReader reader = accessorReader(j, bin, accessor);
+        const std::string& meaning = semantic[a];
+        int count = accessor["count"];
+        int components = typeComponents(accessor["type"]);
+        int componentType = reader.componentType;
+        bool normalized = reader.normalized;
+        int stride = componentSize(componentType) * components;
+        std::vector<unsigned char> elements;
+        std::vector<unsigned int> indices;
+
+        auto put = [&](int i, int c, int size, const void* value) { memcpy(&elements[(size_t)i * stride + c * size], value, size); };
+        if (meaning == "POSITION" && quantizePositions[accessorMesh[a]]) {
+            glm::vec4 d = dequantize[accessorMesh[a]];
+            componentType = 5122;
+            normalized = false;
+            stride = 8;
+            elements.assign((size_t)count * stride, 0);
+            glm::vec3 lo(32767.0f), hi(-32767.0f);
+            for (int i = 0; i < count; i++) {
+                for (int c = 0; c < 3; c++) {
+                    short q = (short)glm::clamp(lroundf((reader.read(i, c) - d[c]) / d.w), -32767L, 32767L);
+                    put(i, c, 2, &q);
+                    lo[c] = glm::min(lo[c], (float)q);
+                    hi[c] = glm::max(hi[c], (float)q);
+                }
+            }
+            accessor["min"] = {lo.x, lo.y, lo.z};
+            accessor["max"] = {hi.x, hi.y, hi.z};
+        } else if (meaning == "NORMAL") {
+            componentType = 5120;
+            normalized = true;
+            stride = 4;
+            elements.assign((size_t)count * stride, 0);
+            for (int i = 0; i < count; i++) {
+                glm::vec3 n(reader.read(i, 0), reader.read(i, 1), reader.read(i, 2));
+                if (glm::length(n) > 0.0f) n = glm::normalize(n);
+                for (int c = 0; c < 3; c++) elements[i * stride + c] = (unsigned char)(signed char)lroundf(n[c] * 127.0f);
+            }
+        } else if (meaning.rfind("TEXCOORD_", 0) == 0) {
+            bool unitRange = true;
+            for (int i = 0; i < count && unitRange; i++) {
+                for (int c = 0; c < 2; c++) unitRange = unitRange && reader.read(i, c) >= 0.0f && reader.read(i, c) <= 1.0f;
+            }
+            componentType = unitRange ? 5123 : 5126;
+            normalized = unitRange;
+            stride = unitRange ? 4 : 8;
+            elements.assign((size_t)count * stride, 0);
+            for (int i = 0; i < count; i++) {
+                for (int c = 0; c < 2; c++) {
+                    float uv = reader.read(i, c);
+                    unsigned short q = (unsigned short)lroundf(uv * 65535.0f);
+                    if (unitRange) put(i, c, 2, &q);
+                    else put(i, c, 4, &uv);
+                }
+            }
+        } else if (meaning.rfind("JOINTS_", 0) == 0) {
+            float maxJoint = 0.0f;
+            for (int i = 0; i < count * 4; i++) maxJoint = glm::max(maxJoint, reader.read(i / 4, i % 4));
+            componentType = maxJoint < 256.0f ? 5121 : 5123;
+            stride = maxJoint < 256.0f ? 4 : 8;
+            elements.assign((size_t)count * stride, 0);
+            for (int i = 0; i < count; i++) {
+                for (int c = 0; c < 4; c++) {
+                    unsigned short joint = (unsigned short)reader.read(i, c);
+                    if (stride == 4) elements[i * stride + c] = (unsigned char)joint;
+                    else put(i, c, 2, &joint);
+                }
+            }
+        } else if (meaning.rfind("WEIGHTS_", 0) == 0) {
+            componentType = 5121;
+            normalized = true;
+            stride = 4;
+            elements.assign((size_t)count * stride, 0);
+            for (int i = 0; i < count; i++) {
+                glm::vec4 w(reader.read(i, 0), reader.read(i, 1), reader.read(i, 2), reader.read(i, 3));
+                float total = w.x + w.y + w.z + w.w;
+                if (total <= 0.0f) continue;
+                // Sum to exactly 255; rounding error goes to the largest weight
+                int sum = 0, largest = 0;
+                for (int c = 0; c < 4; c++) {
+                    elements[i * stride + c] = (unsigned char)lroundf(w[c] / total * 255.0f);
+                    sum += elements[i * stride + c];
+                    if (w[c] > w[largest]) largest = c;
+                }
+                elements[i * stride + largest] = (unsigned char)(elements[i * stride + largest] + 255 - sum);
+            }
+        } else if (meaning == "INDICES") {
+            indices.resize(count);
+            unsigned int maxIndex = 0;
+            for (int i = 0; i < count; i++) {
+                indices[i] = (unsigned int)reader.read(i, 0);
+                maxIndex = glm::max(maxIndex, indices[i]);
+            }
+            componentType = maxIndex < 65536 ? 5123 : 5125;
+            stride = componentSize(componentType);
+            elements.assign((size_t)count * stride, 0);
+            for (int i = 0; i < count; i++) {
+                unsigned short index16 = (unsigned short)indices[i];
+                if (stride == 2) put(i, 0, 2, &index16);
+                else put(i, 0, 4, &indices[i]);
+            }
+        } else {
+            elements.resize((size_t)count * stride);
+            for (int i = 0; i < count; i++) memcpy(&elements[(size_t)i * stride], reader.data + (size_t)i * reader.stride, stride);
+        }
+
+        json view;
+        bool meshStream = !meaning.empty() && (meaning == "INDICES" ? count % 3 == 0 : stride % 4 == 0);
+        if (meshStream) {
+            std::vector<unsigned char> encoded = (meaning == "INDICES") ? encodeIndexBuffer(indices.data(), count)
+                                                                        : encodeVertexBuffer(elements.data(), count, stride);
+            // Every stream is decoded again before it's written
+            std::vector<unsigned char> decoded(elements.size());
+            bool roundTrip;
+            if (meaning == "INDICES") {
+                std::vector<unsigned int> check(count);
+                roundTrip = decodeIndexBuffer(check.data(), count, encoded.data(), encoded.size()) &&
+                            sameTriangles(indices.data(), check.data(), count);
+            } else {
+                roundTrip = decodeVertexBuffer(decoded.data(), count, stride, encoded.data(), encoded.size()) && decoded == elements;
+            }
+            if (!roundTrip) {
+                std::cout << "Cannot cook " << path << ": accessor " << a << " doesn't survive compression" << std::endl;
+                return false;
+            }
+            packed.resize((packed.size() + 3) & ~(size_t)3);
+            json ext = {{"buffer", 0}, {"byteOffset", packed.size()}, {"byteLength", encoded.size()}, {"byteStride", stride},
+                        {"count", count}, {"mode", meaning == "INDICES" ? "TRIANGLES" : "ATTRIBUTES"}};
+            packed.insert(packed.end(), encoded.begin(), encoded.end());
+            view = {{"buffer", 1}, {"byteOffset", fallbackBytes}, {"byteLength", elements.size()}};
+            if (meaning != "INDICES") view["byteStride"] = stride;
+            view["extensions"]["EXT_meshopt_compression"] = ext;
+            fallbackBytes += (elements.size() + 3) & ~(size_t)3;
+            meshBytesBefore += (size_t)count * componentSize(reader.componentType) * components;
+            meshBytesQuantized += elements.size();
+            meshBytesCompressed += encoded.size();
+        } else {
+            packed.resize((packed.size() + 3) & ~(size_t)3);
+            view = {{"buffer", 0}, {"byteOffset", packed.size()}, {"byteLength", elements.size()}};
+            packed.insert(packed.end(), elements.begin(), elements.end());
+        }
+        views.push_back(view);
+
+        accessor["bufferView"] = views.size() - 1;
+        accessor.erase("byteOffset");
+        if (componentType != reader.componentType || normalized != reader.normalized) {
+            if (meaning != "POSITION") {
+                accessor.erase("min");
+                accessor.erase("max");
+            }
+            accessor["componentType"] = componentType;
+            if (normalized) accessor["normalized"] = true;
+            else accessor.erase("normalized");
+        }
+    }
+
+    // Fold each quantized mesh's dequantization into the nodes that place it
+    for (auto& node : j["nodes"]) {
+        if (!node.contains("mesh") || !quantizePositions[(int)node["mesh"]]) continue;
+        glm::vec4 d = dequantize[(int)node["mesh"]];
+        if (node.contains("matrix")) {
+            glm::mat4 m = nodeLocalTransform(node) * glm::translate(glm::mat4(1.0f), glm::vec3(d)) * glm::scale(glm::mat4(1.0f), glm::vec3(d.w));
+            for (int i = 0; i < 16; i++) node["matrix"][i] = m[i / 4][i % 4];
+        } else {
+            glm::vec3 t(0.0f), s(1.0f);
+            glm::quat r(1.0f, 0.0f, 0.0f, 0.0f);
+            if (node.contains("translation")) t = glm::vec3(node["translation"][0], node["translation"][1], node["translation"][2]);
+            if (node.contains("rotation")) r = glm::quat(node["rotation"][3], node["rotation"][0], node["rotation"][1], node["rotation"][2]);
+            if (node.contains("scale")) s = glm::vec3(node["scale"][0], node["scale"][1], node["scale"][2]);
+            t += r * (s * glm::vec3(d));
+            s *= d.w;
+            node["translation"] = {t.x, t.y, t.z};
+            node["scale"] = {s.x, s.y, s.z};
+        }
+    }
+
+    std::string stem = path.substr(0, path.find_last_of('.'));
+    std::string binName = stem.substr(stem.find_last_of("/\\") + 1) + ".meshopt.bin";
+    j["bufferViews"] = views;
+    j["buffers"] = json::array({{{"byteLength", packed.size()}, {"uri", urlEncode(binName)}}});
+    if (fallbackBytes > 0) {
+        j["buffers"].push_back({{"byteLength", fallbackBytes}, {"extensions", {{"EXT_meshopt_compression", {{"fallback", true}}}}}});
+    }
+    for (const char* key : {"extensionsUsed", "extensionsRequired"}) {
+        for (const char* extension : {"KHR_mesh_quantization", "EXT_meshopt_compression"}) {
+            if (!j.contains(key)) j[key] = json::array();
+            if (std::find(j[key].begin(), j[key].end(), extension) == j[key].end()) j[key].push_back(extension);
+        }
+    }
+
+    std::string gltfText = j.dump();
+    std::ofstream gltfOut(stem + ".meshopt.gltf");
+    std::ofstream binOut(stem + ".meshopt.bin", std::ios::binary);
+    gltfOut << gltfText;
+    binOut.write((const char*)packed.data(), packed.size());
+    if (!gltfOut || !binOut) {
+        std::cout << "Failed to write " << stem << ".meshopt.gltf/.bin" << std::endl;
+        return false;
+    }
+    std::ifstream source(path, std::ios::binary | std::ios::ate);
+    std::cout << "Cooked " << path << ": gltf " << (size_t)source.tellg() / 1024 << " -> " << gltfText.size() / 1024
+              << " KB, bin " << sourceBinBytes / 1024 << " -> " << packed.size() / 1024 << " KB; mesh streams "
+              << meshBytesBefore / 1024 << " KB, quantized " << meshBytesQuantized / 1024 << " KB, compressed "
+              << meshBytesCompressed / 1024 << " KB" << std::endl;
+    return true;
+}
+
+// Frustum Culling
+// Scene objects register world-space AABBs each frame and are tested against
+// the six view-projection planes in one pass. Boxes are kept as structure of
+// arrays so the SSE path tests four of them per plane at a time.
+struct FrustumCuller {
+    glm::vec4 planes[6];
+    std::vector<float> centerX, centerY, centerZ, extentX, extentY, extentZ;
+    std::vector<unsigned char> visible;
+    int visibleCount = 0;
+    int culledCount = 0;
+
+    // Planes from the combined matrix (Gribb/Hartmann); inside is n.p + w >= 0
+    void begin(const glm::mat4& viewProjection) {
+        glm::mat4 m = glm::transpose(viewProjection);
+        planes[0] = m[3] + m[0];
+        planes[1] = m[3] - m[0];
+        planes[2] = m[3] + m[1];
+        planes[3] = m[3] - m[1];
+        planes[4] = m[3] + m[2];
+        planes[5] = m[3] - m[2];
+        centerX.clear(); centerY.clear(); centerZ.clear();
+        extentX.clear(); extentY.clear(); extentZ.clear();
+    }
+
+    // Adds a model-space box under 'model' and returns its slot in 'visible'
+    int add(const glm::mat4& model, glm::vec3 boundsMin, glm::vec3 boundsMax) {
+        glm::vec3 center = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+        glm::vec3 halfSize = (boundsMax - boundsMin) * 0.5f;
+        glm::vec3 extent(0.0f);
+        for (int c = 0; c < 3; c++) extent += glm::abs(glm::vec3(model[c])) * halfSize[c];
+        centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+        extentX.push_back(extent.x); extentY.push_back(extent.y); extentZ.push_back(extent.z);
+        return (int)centerX.size() - 1;
+    }
+
+    void cull() {
+        size_t count = centerX.size();
+        size_t padded = (count + 3) & ~(size_t)3;
+        // Padding boxes sit at the origin with no size; their results are ignored
+        centerX.resize(padded, 0.0f); centerY.resize(padded, 0.0f); centerZ.resize(padded, 0.0f);
+        extentX.resize(padded, 0.0f); extentY.resize(padded, 0.0f); extentZ.resize(padded, 0.0f);
+        visible.resize(padded);
+        for (size_t i = 0; i < padded; i += 4) {
+#if defined(__SSE__) || defined(_M_X64)
+            __m128 cx = _mm_loadu_ps(&centerX[i]), cy = _mm_loadu_ps(&centerY[i]), cz = _mm_loadu_ps(&centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < 6; p++) {
+                const glm::vec4& plane = planes[p];
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+                                             _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(fabsf(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(fabsf(plane.y)))),
+                                           _mm_mul_ps(ez, _mm_set1_ps(fabsf(plane.z))));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            }
+            int mask = _mm_movemask_ps(outside);
+            for (int k = 0; k < 4; k++) visible[i + k] = !(mask & (1 << k));
+#else
+            for (size_t k = i; k < i + 4; k++) {
+                bool inside = true;
+                for (int p = 0; p < 6 && inside; p++) {
+                    const glm::vec4& plane = planes[p];
+                    float distance = plane.x * centerX[k] + plane.y * centerY[k] + plane.z * centerZ[k] + plane.w;
+                    float radius = fabsf(plane.x) * extentX[k] + fabsf(plane.y) * extentY[k] + fabsf(plane.z) * extentZ[k];
+                    inside = distance + radius >= 0.0f;
+                }
+                visible[k] = inside;
+            }
+#endif
+        }
+        visibleCount = 0;
+        for (size_t i = 0; i < count; i++) visibleCount += visible[i];
+        culledCount = (int)count - visibleCount;
+        centerX.resize(count); centerY.resize(count); centerZ.resize(count);
+        extentX.resize(count); extentY.resize(count); extentZ.resize(count);
+    }
+};
+
+FrustumCuller frustumCuller;
+
+// Render Queue
+// Subsystems submit draw packets with a 64-bit sort key instead of issuing GL
+// calls directly. The queue radix-sorts the keys once per frame and emits the
+// draws, skipping program/texture/VAO binds that are already current.
+enum RenderPass {
+    PASS_SCENE = 0,      // opaque geometry, sorted by state then front-to-back
+    PASS_BACKGROUND = 1, // far-plane sky, depth test only
+    PASS_UI = 2          // blended overlay, kept in submission order
+};
+
+// Key layout: pass [63..60] | program [59..52] | texture [51..40] | VAO [39..28] | depth [27..4]
+unsigned long long makeSortKey(RenderPass pass, unsigned int program, unsigned int texture, unsigned int VAO, float depth) {
+    unsigned long long depthBits = (unsigned long long)(glm::clamp(depth, 0.0f, 1.0f) * 0xFFFFFF);
+    return ((unsigned long long)pass << 60) |
+           ((unsigned long long)(program & 0xFF) << 52) |
+           ((unsigned long long)(texture & 0xFFF) << 40) |
+           ((unsigned long long)(VAO & 0xFFF) << 28) |
+           (depthBits << 4);
+}
+
+// Passes that need a fixed order (blending) sort by submission sequence instead of state
+unsigned long long makeOrderedKey(RenderPass pass, unsigned int sequence) {
+    return ((unsigned long long)pass << 60) | sequence;
+}
+
+struct DrawPacket {
+    unsigned long long key;
+    unsigned int program;
+    GLenum textureTarget; // 0 means GL_TEXTURE_2D
+    unsigned int texture;
+    unsigned int VAO;
+    GLenum mode;
+    int first;     // first vertex, or byte offset into the index buffer
+    int count;
+    int indexType; // 0 for glDrawArrays
+    glm::mat4 model;
+    glm::vec4 color;
+    glm::vec2 texScale;
+    glm::vec4 atlasRect;
+    bool skinned;
+    bool useMaterials;
+    unsigned int materialBlock; // material UBO for useMaterials, 0 keeps the bound one
+    int instanceCount; // > 0 draws that many instances (of every multi-draw range too)
+    // Multi-draw: when multiDrawCount > 0 these replace first/count, and the
+    // arrays must stay alive until the queue is flushed
+    int multiDrawCount;
+    const GLsizei* multiCounts;
+    const void* const* multiOffsets;
+    const GLint* multiBaseVertices;
+};
+
+struct RenderStats {
+    int packets;
+    int draws;
+    int programBinds;
+    int textureBinds;
+    int vaoBinds;
+    int triangles;
+};
+
+RenderStats frameStats = {};
+
+struct RenderQueue {
+    struct SortItem {
+        unsigned long long key;
+        unsigned int index;
+    };
+
+    // Uniform locations looked up once per program instead of every frame
+    struct ProgramUniforms {
+        unsigned int program;
+        int model;
+        int objectColor;
+        int textColor;
+        int texScale;
+        int atlasRect;
+        int skinned;
+        int useMaterials;
+        int instanced;
+    };
+
+    std::vector<DrawPacket> packets;
+    std::vector<SortItem> items;
+    std::vector<SortItem> scratch;
+    std::vector<ProgramUniforms> uniformCache;
+    unsigned int sequence = 0;
+    std::function<void(int)> onPassBegin; // called before a pass's first draw, e.g. to switch render targets
+
+    void submit(const DrawPacket& packet) {
+        packets.push_back(packet);
+    }
+
+    unsigned int nextSequence() {
+        return sequence++;
+    }
+
+    const ProgramUniforms& uniformsFor(unsigned int program) {
+        for (const auto& u : uniformCache) {
+            if (u.program == program) return u;
+        }
+        ProgramUniforms u;
+        u.program = program;
+        u.model = glGetUniformLocation(program, "model");
+        u.objectColor = glGetUniformLocation(program, "objectColor");
+        u.textColor = glGetUniformLocation(program, "textColor");
+        u.texScale = glGetUniformLocation(program, "texScale");
+        u.atlasRect = glGetUniformLocation(program, "atlasRect");
+        u.skinned = glGetUniformLocation(program, "skinned");
+        u.useMaterials = glGetUniformLocation(program, "useMaterials");
+        u.instanced = glGetUniformLocation(program, "instanced");
+        uniformCache.push_back(u);
+        return uniformCache.back();
+    }
+
+    // LSD radix sort, 8 bits per pass. Stable, so equal keys keep submission order.
+    void sort() {
+        items.resize(packets.size());
+        for (unsigned int i = 0; i < packets.size(); i++) {
+            items[i].key = packets[i].key;
+            items[i].index = i;
+        }
+        if (items.empty()) return;
+        scratch.resize(items.size());
+
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = {0};
+            for (const auto& item : items) counts[(item.key >> shift) & 0xFF]++;
+            if (counts[(items[0].key >> shift) & 0xFF] == items.size()) continue; // every key shares this digit
+
+            size_t offset = 0;
+            for (int i = 0; i < 256; i++) {
+                size_t count = counts[i];
+                counts[i] = offset;
+                offset += count;
+            }
+            for (const auto& item : items) scratch[counts[(item.key >> shift) & 0xFF]++] = item;
+            items.swap(scratch);
+        }
+    }
+
+    void applyPassState(int pass) {
+        if (pass == PASS_SCENE) {
+            glState.setDepthTest(true);
+            glState.depthFunc(GL_LESS);
+            glState.depthMask(true);
+            glState.setBlend(false);
+        } else if (pass == PASS_BACKGROUND) {
+            glState.setDepthTest(true);
+            glState.depthFunc(GL_LEQUAL);
+            glState.depthMask(false);
+            glState.setBlend(false);
+        } else {
+            glState.setDepthTest(false);
+            glState.setBlend(true);
+            glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+    }
+
+    void flush() {
+        sort();
+        frameStats = {};
+        frameStats.packets = (int)packets.size();
+
+        int currentPass = -1;
+        unsigned int currentProgram = 0;
+        const ProgramUniforms* uniforms = nullptr;
+
+        // Binds that are already current (from the pass hook, or from last
+        // frame when nothing else touched them) are skipped by glState
+        for (const auto& item : items) {
+            const DrawPacket& p = packets[item.index];
+
+            int pass = (int)(item.key >> 60);
+            if (pass != currentPass) {
+                if (onPassBegin) onPassBegin(pass);
+                applyPassState(pass);
+                currentPass = pass;
+            }
+
+            if (glState.useProgram(p.program)) frameStats.programBinds++;
+            if (!uniforms || p.program != currentProgram) {
+                currentProgram = p.program;
+                uniforms = &uniformsFor(p.program);
+            }
+            if (glState.bindTexture(p.textureTarget ? p.textureTarget : GL_TEXTURE_2D, p.texture)) frameStats.textureBinds++;
+            if (glState.bindVertexArray(p.VAO)) frameStats.vaoBinds++;
+            if (p.materialBlock) glState.bindUniformBlock(1, p.materialBlock);
+
+            if (uniforms->model >= 0) glUniformMatrix4fv(uniforms->model, 1, GL_FALSE, glm::value_ptr(p.model));
+            if (uniforms->objectColor >= 0) glUniform3f(uniforms->objectColor, p.color.r, p.color.g, p.color.b);
+            if (uniforms->textColor >= 0) glUniform4f(uniforms->textColor, p.color.r, p.color.g, p.color.b, p.color.a);
+            if (uniforms->texScale >= 0) glUniform2f(uniforms->texScale, p.texScale.x, p.texScale.y);
+            if (uniforms->atlasRect >= 0) glUniform4f(uniforms->atlasRect, p.atlasRect.x, p.atlasRect.y, p.atlasRect.z, p.atlasRect.w);
+            if (uniforms->skinned >= 0) glUniform1i(uniforms->skinned, p.skinned);
+            if (uniforms->useMaterials >= 0) glUniform1i(uniforms->useMaterials, p.useMaterials);
+            if (uniforms->instanced >= 0) glUniform1i(uniforms->instanced, p.instanceCount > 0);
+
+            if (p.multiDrawCount > 0) {
+                if (p.instanceCount > 0) {
+                    // No instanced multi-draw in GL 3.3: one call per range, independent of the instance count
+                    for (int d = 0; d < p.multiDrawCount; d++) {
+                        glDrawElementsInstancedBaseVertex(p.mode, p.multiCounts[d], p.indexType, p.multiOffsets[d], p.instanceCount, p.multiBaseVertices[d]);
+                    }
+                } else {
+                    glMultiDrawElementsBaseVertex(p.mode, p.multiCounts, p.indexType, p.multiOffsets, p.multiDrawCount, p.multiBaseVertices);
+                }
+                for (int d = 0; d < p.multiDrawCount; d++) {
+                    if (p.mode == GL_TRIANGLES) frameStats.triangles += p.multiCounts[d] / 3 * glm::max(p.instanceCount, 1);
+                }
+            } else {
+                if (p.instanceCount > 0) glDrawArraysInstanced(p.mode, p.first, p.count, p.instanceCount);
+                else if (p.indexType != 0) glDrawElements(p.mode, p.count, p.indexType, (void*)(size_t)p.first);
+                else glDrawArrays(p.mode, p.first, p.count);
+                if (p.mode == GL_TRIANGLES) frameStats.triangles += p.count / 3;
+                else if (p.mode == GL_TRIANGLE_STRIP) frameStats.triangles += (p.count - 2) * glm::max(p.instanceCount, 1);
+            }
+            frameStats.draws++;
+        }
+
+        packets.clear();
+        sequence = 0;
+    }
+};
+
+RenderQueue renderQueue;
+
+// Dynamic Resolution
+// The scene and background render into an offscreen target at a fraction of
+// the window size, then get stretched to the output with bilinear filtering
+// before the UI draws at native resolution. A controller moves the fraction
+// to keep the GPU time of the scene passes under a budget. Timer queries are
+// read back a few frames late, so measuring never stalls the pipeline.
+const float DYNRES_MIN_SCALE = 0.5f;
+const float DYNRES_STEP = 1.0f / 32.0f; // scales snap to this grid so small noise doesn't resize
+const int DYNRES_QUERY_COUNT = 4;
+
+const char* upscaleVertexShaderSource = R"(
+    #version 330 core
+    out vec2 ScreenUV;
+
+    void main()
+    {
+        vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+        ScreenUV = pos * 0.5 + 0.5;
+        gl_Position = vec4(pos, 0.0, 1.0);
+    }
+)";
+
+const char* upscaleFragmentShaderSource = R"(
+    #version 330 core
+    out vec4 FragColor;
+    in vec2 ScreenUV;
+
+    uniform sampler2D scene;
+    uniform vec2 uvScale; // rendered part of the target
+    uniform vec2 uvMax;   // last texel center inside it, so filtering never reads stale texels
+
+    void main()
+    {
+        FragColor = texture(scene, min(ScreenUV * uvScale, uvMax));
+    }
+)";
+
+struct DynamicResolution {
+    bool enabled = false;
+    float budgetMs = 0.0f;
+    float scale = 1.0f;
+    float gpuMs = 0.0f;        // smoothed scene GPU time
+    unsigned int FBO = 0, colorTexture = 0, depthRBO = 0;
+    unsigned int program = 0, VAO = 0;
+    unsigned int queries[DYNRES_QUERY_COUNT];
+    unsigned int queriesIssued = 0, queriesRead = 0;
+    bool timing = false;       // a query is open for this frame's scene
+    bool active = false;       // scene target bound, resolve still pending
+    int outputFBO = 0;
+
+    int width() const { return glm::max(1, (int)(SCR_WIDTH * scale + 0.5f)); }
+    int height() const { return glm::max(1, (int)(SCR_HEIGHT * scale + 0.5f)); }
+
+    void init(float budget) {
+        budgetMs = budget;
+        enabled = budget > 0.0f;
+        if (!enabled) return;
+        // Allocated once at full size; lower scales just use a smaller viewport of it
+        glGenTextures(1, &colorTexture);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT);
+
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &outputFBO);
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Dynamic resolution framebuffer is incomplete, rendering at native resolution" << std::endl;
+            enabled = false;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+
+        program = createShaderProgram(upscaleVertexShaderSource, upscaleFragmentShaderSource);
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "scene"), 0);
+        glGenVertexArrays(1, &VAO);
+        glGenQueries(DYNRES_QUERY_COUNT, queries);
+    }
+
+    // Redirects the frame's scene passes to the scaled target
+    void beginScene() {
+        if (!enabled) return;
+        collectTimings();
+        outputFBO = glState.boundFramebuffer();
+        glState.bindFramebuffer(FBO);
+        glState.viewport(0, 0, width(), height());
+        timing = queriesIssued - queriesRead < (unsigned int)DYNRES_QUERY_COUNT;
+        if (timing) glBeginQuery(GL_TIME_ELAPSED, queries[queriesIssued % DYNRES_QUERY_COUNT]);
+        active = true;
+    }
+
+    // Stretches the scene onto the output; everything drawn after is native resolution
+    void resolve() {
+        if (!active) return;
+        active = false;
+        if (timing) {
+            glEndQuery(GL_TIME_ELAPSED);
+            queriesIssued++;
+        }
+        glState.bindFramebuffer(outputFBO);
+        glState.viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+        glState.setDepthTest(false);
+        glState.setBlend(false);
+        glState.useProgram(program);
+        glUniform2f(glGetUniformLocation(program, "uvScale"), (float)width() / SCR_WIDTH, (float)height() / SCR_HEIGHT);
+        glUniform2f(glGetUniformLocation(program, "uvMax"), (width() - 0.5f) / SCR_WIDTH, (height() - 0.5f) / SCR_HEIGHT);
+        glState.bindTexture(GL_TEXTURE_2D, colorTexture);
+        glState.bindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // Reads whichever queries have finished and steers the scale toward the budget.
+    // Scene cost is roughly proportional to pixel count, so the scale moves with the
+    // square root of the time ratio; a dead band around the budget keeps it steady.
+    void collectTimings() {
+        while (queriesRead < queriesIssued) {
+            unsigned int query = queries[queriesRead % DYNRES_QUERY_COUNT];
+            int available = 0;
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) break;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+            queriesRead++;
+            float ms = nanoseconds / 1e6f;
+            gpuMs = gpuMs > 0.0f ? glm::mix(gpuMs, ms, 0.3f) : ms;
+        }
+        if (gpuMs <= 0.0f || (gpuMs <= budgetMs && gpuMs >= budgetMs * 0.8f)) return;
+        float target = scale * sqrtf(budgetMs * 0.9f / gpuMs);
+        float next = glm::clamp(roundf(glm::mix(scale, target, 0.5f) / DYNRES_STEP) * DYNRES_STEP, DYNRES_MIN_SCALE, 1.0f);
+        if (next != scale) {
+            scale = next;
+            gpuMs = 0.0f; // old samples describe the previous resolution
+            queriesRead = queriesIssued; // and so do the ones still in flight
+        }
+    }
+
+    void destroy() {
+        if (!FBO) return;
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteTextures(1, &colorTexture);
+        glDeleteRenderbuffers(1, &depthRBO);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteProgram(program);
+        glDeleteQueries(DYNRES_QUERY_COUNT, queries);
+    }
+};
+
+DynamicResolution dynamicResolution;
+
+// Text Shader
+const char* textVertexShaderSource = R"(
+    #version 330 core
+    layout (location = 0) in vec4 vertex; // <vec2 pos, vec2 tex>
+    out vec2 TexCoords;
+    uniform mat4 projection;
+    void main() {
+        gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
+        TexCoords = vertex.zw;
+    }
+)";
+
+const char* textFragmentShaderSource = R"(
+    #version 330 core
+    in vec2 TexCoords;
+    out vec4 color;
+    uniform sampler2D text;
+    uniform vec4 textColor;
+    void main() {
+        vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
+        color = textColor * sampled;
+    }
+)";
+
+stbtt_bakedchar cdata[96]; 
+std::vector<unsigned char> fontBitmap; // 512x512 coverage, copied into the UI atlas
+unsigned int textVAO, textVBO;
+unsigned int textShaderProgram;
+
+// UI geometry for the whole frame, <vec2 pos, vec2 tex> per vertex, uploaded once before the queue flushes
+std::vector<glm::vec4> uiVertices;
+size_t uiBufferCapacity = 0;
+
+void initTextRenderer(const char* fontPath) {
+    textShaderProgram = createShaderProgram(textVertexShaderSource, textFragmentShaderSource);
+
+    // The UI projection and sampler never change, so set them once
+    glUseProgram(textShaderProgram);
+    glUniform1i(glGetUniformLocation(textShaderProgram, "text"), 0);
+    glm::mat4 projection = glm::ortho(0.0f, (float)SCR_WIDTH, (float)SCR_HEIGHT, 0.0f);
+    glUniformMatrix4fv(glGetUniformLocation(textShaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+    glGenVertexArrays(1, &textVAO);
+    glGenBuffers(1, &textVBO);
+    glBindVertexArray(textVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    
+    // Load font
     std::ifstream file(fontPath, std::ios::binary | std::ios::ate);
     if (!file.is_open()) {
         std::cout << "Failed to open font file: " << fontPath << std::endl;
         return;
     }
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    std::vector<unsigned char> buffer(size);
-    if (!file.read((char*)buffer.data(), size)) return;
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    std::vector<unsigned char> buffer(size);
+    if (!file.read((char*)buffer.data(), size)) return;
+
+    fontBitmap.resize(512*512);
+    stbtt_BakeFontBitmap(buffer.data(), 0, 32.0, fontBitmap.data(), 512, 512, 32, 96, cdata);
+}
+
+// Queues vertices [first, uiVertices.size()) as one UI draw
+void SubmitUI(unsigned int texture, int first, glm::vec4 color) {
+    int count = (int)uiVertices.size() - first;
+    if (count <= 0) return;
+
+    DrawPacket packet = {};
+    packet.key = makeOrderedKey(PASS_UI, renderQueue.nextSequence());
+    packet.program = textShaderProgram;
+    packet.texture = texture;
+    packet.VAO = textVAO;
+    packet.mode = GL_TRIANGLES;
+    packet.first = first;
+    packet.count = count;
+    packet.color = color;
+    renderQueue.submit(packet);
+}
+
+void PushUIQuad(float x0, float y0, float x1, float y1, float s0, float t0, float s1, float t1) {
+    uiVertices.push_back(glm::vec4(x0, y1, s0, t1));
+    uiVertices.push_back(glm::vec4(x1, y0, s1, t0));
+    uiVertices.push_back(glm::vec4(x0, y0, s0, t0));
+
+    uiVertices.push_back(glm::vec4(x0, y1, s0, t1));
+    uiVertices.push_back(glm::vec4(x1, y1, s1, t1));
+    uiVertices.push_back(glm::vec4(x1, y0, s1, t0));
+}
+
+// Uploads this frame's UI geometry in one call, growing the buffer only when needed
+void UploadUIVertices() {
+    if (uiVertices.empty()) return;
+    size_t bytes = uiVertices.size() * sizeof(glm::vec4);
+    glState.bindBuffer(GL_ARRAY_BUFFER, textVBO);
+    if (bytes > uiBufferCapacity) uiBufferCapacity = bytes * 2;
+    glBufferData(GL_ARRAY_BUFFER, uiBufferCapacity, NULL, GL_STREAM_DRAW); // grows, or orphans last frame's storage
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, uiVertices.data());
+    uiVertices.clear();
+}
+
+void RenderText(std::string text, float x, float y, float scale, glm::vec4 color) {
+    int first = (int)uiVertices.size();
+    for (char c : text) {
+        if (c < 32 || c >= 128) continue;
+        stbtt_aligned_quad q;
+        stbtt_GetBakedQuad(cdata, 512, 512, c-32, &x, &y, &q, 1);
+        // Baked UVs are relative to the 512x512 font bitmap, remap them into the atlas
+        PushUIQuad(q.x0, q.y0, q.x1, q.y1,
+                   fontRect.x + q.s0 * fontRect.z, fontRect.y + q.t0 * fontRect.w,
+                   fontRect.x + q.s1 * fontRect.z, fontRect.y + q.t1 * fontRect.w);
+    }
+    SubmitUI(atlasTexture, first, color);
+}
+
+struct Button {
+    float x, y, w, h;
+    std::string text;
+    glm::vec4 color;
+    glm::vec4 hoverColor;
+    
+    bool isMouseOver(double mx, double my) const {
+        return mx >= x && mx <= x + w && my >= y && my <= y + h;
+    }
+};
+
+void RenderQuad(float x, float y, float w, float h, glm::vec4 color) {
+    int first = (int)uiVertices.size();
+    glm::vec2 white(whiteRect.x + whiteRect.z / 2, whiteRect.y + whiteRect.w / 2);
+    PushUIQuad(x, y, x + w, y + h, white.x, white.y, white.x, white.y);
+    SubmitUI(atlasTexture, first, color);
+}
+
+// 2px outline built from four quads, so it batches with the rest of the UI
+void RenderBorder(float x, float y, float w, float h, glm::vec4 color) {
+    const float t = 2.0f;
+    glm::vec2 s(whiteRect.x + whiteRect.z / 2, whiteRect.y + whiteRect.w / 2);
+    int first = (int)uiVertices.size();
+    PushUIQuad(x - t/2, y - t/2, x + w + t/2, y + t/2, s.x, s.y, s.x, s.y);         // top
+    PushUIQuad(x - t/2, y + h - t/2, x + w + t/2, y + h + t/2, s.x, s.y, s.x, s.y); // bottom
+    PushUIQuad(x - t/2, y + t/2, x + t/2, y + h - t/2, s.x, s.y, s.x, s.y);         // left
+    PushUIQuad(x + w - t/2, y + t/2, x + w + t/2, y + h - t/2, s.x, s.y, s.x, s.y); // right
+    SubmitUI(atlasTexture, first, color);
+}
+
+void RenderButton(Button& btn, double mx, double my) {
+    glm::vec4 color = btn.isMouseOver(mx, my) ? btn.hoverColor : btn.color;
+    RenderQuad(btn.x, btn.y, btn.w, btn.h, color);
+    RenderBorder(btn.x, btn.y, btn.w, btn.h, glm::vec4(1.0f));
+    
+    // Approximate text centering
+    float charWidth = 15.0f; // Approx width per character at scale 1.0
+    float textWidth = btn.text.length() * charWidth;
+    float textX = btn.x + (btn.w - textWidth) / 2.0f;
+    float textY = btn.y + (btn.h / 2.0f) - 5.0f; // Vertical adjustment
+
+    RenderText(btn.text, textX, textY, 1.0f, glm::vec4(1.0f));
+}
+
+// Frame Capture
+// Every rendered frame is read back through a ring of pixel buffer objects:
+// frame N's glReadPixels only queues a copy into its PBO, and the PBO is mapped
+// two frames later when its fence has long signaled, so the render thread
+// never waits on the GPU. A writer thread converts and streams the frames as
+// raw Y4M (4:2:0) or concatenated binary PPM, chosen by the file extension.
+const int CAPTURE_RING_SIZE = 3;  // frame N is mapped while frame N+2 renders
+const int CAPTURE_MAX_QUEUED = 8; // frames waiting for the writer before the render thread blocks
+
+struct FrameCapture {
+    int width = 0;
+    int height = 0;
+    bool y4m = false;
+    std::ofstream file;
+    unsigned int pbos[CAPTURE_RING_SIZE] = {};
+    GLsync fences[CAPTURE_RING_SIZE] = {};
+    int issued = 0;    // readbacks queued on the GPU
+    int collected = 0; // readbacks handed to the writer
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<std::vector<unsigned char>> queue; // RGBA, bottom-up rows
+    std::vector<std::vector<unsigned char>> freeFrames;
+    bool finished = false;
+
+    // Render-thread seconds queuing readbacks and mapping finished ones. On
+    // software rasterizers glReadPixels also flushes the frame's rasterization,
+    // so there the headless fps with and without capture is the fairer cost.
+    double issueTime = 0.0;
+    double collectTime = 0.0;
+    double writerTime = 0.0;
+    int stalls = 0;                // times the render thread waited for the writer
+
+    bool start(const std::string& path, int w, int h) {
+        width = w;
+        height = h;
+        y4m = path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+        file.open(path, std::ios::binary);
+        if (!file) {
+            std::cout << "Failed to open capture file: " << path << std::endl;
+            return false;
+        }
+        if (y4m) file << "YUV4MPEG2 W" << width << " H" << height << " F" << SIM_TICK_RATE << ":1 Ip A1:1 C420jpeg\n";
+
+        glGenBuffers(CAPTURE_RING_SIZE, pbos);
+        for (int i = 0; i < CAPTURE_RING_SIZE; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        freeFrames.assign(CAPTURE_MAX_QUEUED, std::vector<unsigned char>(width * height * 4));
+        writer = std::thread(&FrameCapture::writeLoop, this);
+        return true;
+    }
+
+    // Call once the frame is fully rendered, before swapping buffers
+    void captureFrame() {
+        double begin = glfwGetTime();
+        int slot = issued % CAPTURE_RING_SIZE;
+        glState.bindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0); // screenshots read into client memory
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        issued++;
+        issueTime += glfwGetTime() - begin;
+        if (issued - collected >= CAPTURE_RING_SIZE) collect();
+    }
+
+    // Maps the oldest readback and queues a copy for the writer
+    void collect() {
+        double begin = glfwGetTime();
+        int slot = collected % CAPTURE_RING_SIZE;
+        glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        glDeleteSync(fences[slot]);
+        fences[slot] = 0;
+
+        std::vector<unsigned char> frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (freeFrames.empty()) stalls++;
+            queueChanged.wait(lock, [this] { return !freeFrames.empty(); });
+            frame.swap(freeFrames.back());
+            freeFrames.pop_back();
+        }
+        glState.bindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+        const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width * height * 4, GL_MAP_READ_BIT);
+        if (pixels) memcpy(frame.data(), pixels, frame.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        collected++;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(frame));
+        queueChanged.notify_all();
+        collectTime += glfwGetTime() - begin;
+    }
+
+    void writeLoop() {
+        std::vector<unsigned char> out;
+        while (true) {
+            std::vector<unsigned char> frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queueChanged.wait(lock, [this] { return !queue.empty() || finished; });
+                if (queue.empty()) return;
+                frame = std::move(queue.front());
+                queue.pop_front();
+            }
+            auto begin = std::chrono::steady_clock::now();
+            if (y4m) writeY4mFrame(frame, out);
+            else writePpmFrame(frame, out);
+            writerTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            freeFrames.push_back(std::move(frame));
+            queueChanged.notify_all();
+        }
+    }
+
+    void writePpmFrame(const std::vector<unsigned char>& rgba, std::vector<unsigned char>& out) {
+        out.resize(width * height * 3);
+        for (int y = 0; y < height; y++) {
+            const unsigned char* src = &rgba[(height - 1 - y) * width * 4];
+            unsigned char* dst = &out[y * width * 3];
+            for (int x = 0; x < width; x++) {
+                dst[x * 3] = src[x * 4];
+                dst[x * 3 + 1] = src[x * 4 + 1];
+                dst[x * 3 + 2] = src[x * 4 + 2];
+            }
+        }
+        file << "P6\n" << width << " " << height << "\n255\n";
+        file.write((const char*)out.data(), out.size());
+    }
+
+    // Full-range BT.601 with chroma averaged over 2x2 blocks
+    void writeY4mFrame(const std::vector<unsigned char>& rgba, std::vector<unsigned char>& out) {
+        int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+        out.resize(width * height + 2 * chromaWidth * chromaHeight);
+        unsigned char* planeY = out.data();
+        unsigned char* planeU = planeY + width * height;
+        unsigned char* planeV = planeU + chromaWidth * chromaHeight;
+        for (int y = 0; y < height; y++) {
+            const unsigned char* src = &rgba[(height - 1 - y) * width * 4];
+            for (int x = 0; x < width; x++) {
+                int r = src[x * 4], g = src[x * 4 + 1], b = src[x * 4 + 2];
+                planeY[y * width + x] = (unsigned char)((77 * r + 150 * g + 29 * b + 128) >> 8);
+            }
+        }
+        for (int cy = 0; cy < chromaHeight; cy++) {
+            for (int cx = 0; cx < chromaWidth; cx++) {
+                int r = 0, g = 0, b = 0, n = 0;
+                for (int dy = 0; dy < 2; dy++) {
+                    int y = glm::min(cy * 2 + dy, height - 1);
+                    const unsigned char* src = &rgba[(height - 1 - y) * width * 4];
+                    for (int dx = 0; dx < 2; dx++) {
+                        int x = glm::min(cx * 2 + dx, width - 1);
+                        r += src[x * 4]; g += src[x * 4 + 1]; b += src[x * 4 + 2]; n++;
+                    }
+                }
+                r /= n; g /= n; b /= n;
+                planeU[cy * chromaWidth + cx] = (unsigned char)glm::clamp((-43 * r - 85 * g + 128 * b + 32768 + 128) >> 8, 0, 255);
+                planeV[cy * chromaWidth + cx] = (unsigned char)glm::clamp((128 * r - 107 * g - 21 * b + 32768 + 128) >> 8, 0, 255);
+            }
+        }
+        file << "FRAME\n";
+        file.write((const char*)out.data(), out.size());
+    }
+
+    // Drains the frames still in flight, stops the writer and reports the cost
+    void finish() {
+        while (collected < issued) collect();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            queueChanged.notify_all();
+        }
+        writer.join();
+        glDeleteBuffers(CAPTURE_RING_SIZE, pbos);
+        file.close();
+
+        int frames = glm::max(collected, 1);
+        std::cout << "Capture: " << collected << " frames, readback issue " << 1000.0 * issueTime / frames
+                  << " ms/frame, map+copy " << 1000.0 * collectTime / frames << " ms/frame, writer "
+                  << 1000.0 * writerTime / frames << " ms/frame, " << stalls << " writer stalls" << std::endl;
+    }
+};
+
+// Observation Renderer
+// Small grayscale frames for pixel-based agents, rasterized on the CPU with no
+// GL involved: a flat sky, the out-of-bounds bands above and below the course,
+// each pipe's projected box and the bird's collision square. Every shape is a
+// convex polygon after projection, filled row by row with SSE span stores.
+// Environments are passed as a batch and written into one contiguous tensor.
+const int OBS_WIDTH = 84;
+const int OBS_HEIGHT = 84;
+const int OBS_MAX_PIPES = 8;
+const unsigned char OBS_SKY = 40;
+const unsigned char OBS_BAND = 90;
+const unsigned char OBS_PIPE = 160;
+const unsigned char OBS_BIRD = 255;
+const float OBS_BOUND_Y = 5.0f; // checkCollision's ceiling and floor
+
+// What an observation depends on, copied out of the game state per environment
+struct ObservationState {
+    float birdY;
+    float birdRotation; // degrees
+    float cameraY;
+    int pipeCount;
+    float pipeX[OBS_MAX_PIPES];
+    float pipeGapY[OBS_MAX_PIPES];
+};
+
+ObservationState currentObservationState() {
+    ObservationState state;
+    state.birdY = bird.position.y;
+    state.birdRotation = bird.rotation;
+    state.cameraY = cameraY;
+    state.pipeCount = glm::min((int)pipes.size(), OBS_MAX_PIPES);
+    for (int i = 0; i < state.pipeCount; i++) {
+        state.pipeX[i] = pipes[i].x;
+        state.pipeGapY[i] = pipes[i].gapY;
+    }
+    return state;
+}
+
+// Same camera as the render loop, so observations line up with a downscaled frame
+glm::mat4 observationViewProjection(float camY) {
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, camY, 14.0f), glm::vec3(0.0f, camY, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f) * view;
+}
+
+// Model matrices of the observation shapes, shared with the GL reference render
+void observationPipeModels(const ObservationState& state, int pipe, glm::mat4& bottom, glm::mat4& top) {
+    const float pipeHeight = 10.0f;
+    float x = state.pipeX[pipe];
+    float gapY = state.pipeGapY[pipe];
+    bottom = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, gapY - PIPE_GAP/2 - pipeHeight/2, 0.0f)), glm::vec3(PIPE_WIDTH, pipeHeight, 1.0f));
+    top = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, gapY + PIPE_GAP/2 + pipeHeight/2, 0.0f)), glm::vec3(PIPE_WIDTH, pipeHeight, 1.0f));
+}
+
+glm::mat4 observationBirdModel(const ObservationState& state) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, state.birdY, 0.0f));
+    model = glm::rotate(model, glm::radians(state.birdRotation), glm::vec3(0.0f, 0.0f, 1.0f));
+    return glm::scale(model, glm::vec3(bird.size, bird.size, 0.0f));
+}
+
+glm::mat4 observationBandModel(bool above) {
+    const float bandHeight = 20.0f; // well past the frustum at the camera's range
+    float y = above ? OBS_BOUND_Y + bandHeight/2 : -OBS_BOUND_Y - bandHeight/2;
+    return glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, y, 0.0f)), glm::vec3(40.0f, bandHeight, 0.0f));
+}
+
+inline void fillSpan(unsigned char* row, int x0, int x1, unsigned char value) {
+    int x = x0;
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i fill = _mm_set1_epi8((char)value);
+    for (; x + 16 <= x1; x += 16) _mm_storeu_si128((__m128i*)(row + x), fill);
+#endif
+    for (; x < x1; x++) row[x] = value;
+}
+
+// Fills the convex hull of the points (pixel coordinates, y down). Pixels are
+// covered when their center is inside, matching GL's rasterization rule.
+void fillConvexHull(unsigned char* image, glm::vec2* points, int count, unsigned char value) {
+    // Monotone chain hull, so projected boxes can pass all eight corners
+    std::sort(points, points + count, [](const glm::vec2& a, const glm::vec2& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+    glm::vec2 hull[16];
+    int n = 0;
+    auto cross = [](const glm::vec2& o, const glm::vec2& a, const glm::vec2& b) { return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x); };
+    for (int i = 0; i < count; i++) {
+        while (n >= 2 && cross(hull[n - 2], hull[n - 1], points[i]) <= 0.0f) n--;
+        hull[n++] = points[i];
+    }
+    for (int i = count - 2, lower = n + 1; i >= 0; i--) {
+        while (n >= lower && cross(hull[n - 2], hull[n - 1], points[i]) <= 0.0f) n--;
+        hull[n++] = points[i];
+    }
+    n--; // last point repeats the first
+    if (n < 3) return;
+
+    float minY = hull[0].y, maxY = hull[0].y;
+    for (int i = 1; i < n; i++) {
+        minY = glm::min(minY, hull[i].y);
+        maxY = glm::max(maxY, hull[i].y);
+    }
+    int y0 = glm::max(0, (int)ceilf(minY - 0.5f));
+    int y1 = glm::min(OBS_HEIGHT, (int)ceilf(maxY - 0.5f));
+    for (int y = y0; y < y1; y++) {
+        float sy = y + 0.5f;
+        float left = 1e30f, right = -1e30f;
+        for (int i = 0; i < n; i++) {
+            const glm::vec2& a = hull[i];
+            const glm::vec2& b = hull[(i + 1) % n];
+            if ((a.y <= sy) == (b.y <= sy)) continue;
+            float x = a.x + (sy - a.y) * (b.x - a.x) / (b.y - a.y);
+            left = glm::min(left, x);
+            right = glm::max(right, x);
+        }
+        int x0 = glm::max(0, (int)ceilf(left - 0.5f));
+        int x1 = glm::min(OBS_WIDTH, (int)ceilf(right - 0.5f));
+        if (x0 < x1) fillSpan(image + y * OBS_WIDTH, x0, x1, value);
+    }
+}
+
+// Projects the unit cube's corners through mvp (its z extent may be zero for flat shapes)
+void fillProjectedBox(unsigned char* image, const glm::mat4& mvp, unsigned char value) {
+    glm::vec2 points[8];
+    for (int i = 0; i < 8; i++) {
+        glm::vec4 clip = mvp * glm::vec4((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f, 1.0f);
+        points[i] = glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * OBS_WIDTH, (0.5f - clip.y / clip.w * 0.5f) * OBS_HEIGHT);
+    }
+    fillConvexHull(image, points, 8, value);
+}
+
+// Writes count observations of OBS_WIDTH * OBS_HEIGHT bytes (rows top-down) into out
+void renderObservations(const ObservationState* states, int count, unsigned char* out) {
+    for (int e = 0; e < count; e++) {
+        const ObservationState& state = states[e];
+        unsigned char* image = out + (size_t)e * OBS_WIDTH * OBS_HEIGHT;
+        memset(image, OBS_SKY, OBS_WIDTH * OBS_HEIGHT);
+        glm::mat4 viewProj = observationViewProjection(state.cameraY);
+        fillProjectedBox(image, viewProj * observationBandModel(true), OBS_BAND);
+        fillProjectedBox(image, viewProj * observationBandModel(false), OBS_BAND);
+        for (int p = 0; p < state.pipeCount; p++) {
+            glm::mat4 bottom, top;
+            observationPipeModels(state, p, bottom, top);
+            fillProjectedBox(image, viewProj * bottom, OBS_PIPE);
+            fillProjectedBox(image, viewProj * top, OBS_PIPE);
+        }
+        fillProjectedBox(image, viewProj * observationBirdModel(state), OBS_BIRD);
+    }
+}
+
+const char* obsVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+uniform mat4 mvp;
+void main() {
+    gl_Position = mvp * vec4(aPos, 1.0);
+}
+)";
+
+const char* obsFragmentShaderSource = R"(
+#version 330 core
+out vec4 FragColor;
+uniform float value;
+void main() {
+    FragColor = vec4(value);
+}
+)";
+
+// Reference check: draws the same shapes with GL at observation resolution
+// (painter's order, no depth) and returns the fraction of pixels that differ
+// from the CPU rasterizer. The caller's framebuffer and viewport are restored.
+float compareObservationWithGL(const ObservationState* states, int count, const GLTFMesh& cube) {
+    unsigned int program = createShaderProgram(obsVertexShaderSource, obsFragmentShaderSource);
+    int previousFBO, viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFBO);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    unsigned int texture, FBO;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, OBS_WIDTH, OBS_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+    glGenFramebuffers(1, &FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glViewport(0, 0, OBS_WIDTH, OBS_HEIGHT);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(program);
+    glBindVertexArray(cube.VAO);
+    int mvpLoc = glGetUniformLocation(program, "mvp");
+    int valueLoc = glGetUniformLocation(program, "value");
+    auto drawBox = [&](const glm::mat4& mvp, unsigned char value) {
+        glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, glm::value_ptr(mvp));
+        glUniform1f(valueLoc, value / 255.0f);
+        glDrawElements(GL_TRIANGLES, cube.indexCount, cube.indexType, 0);
+    };
+
+    std::vector<unsigned char> cpu(OBS_WIDTH * OBS_HEIGHT), gpu(OBS_WIDTH * OBS_HEIGHT);
+    size_t mismatched = 0;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int e = 0; e < count; e++) {
+        const ObservationState& state = states[e];
+        glClearColor(OBS_SKY / 255.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glm::mat4 viewProj = observationViewProjection(state.cameraY);
+        drawBox(viewProj * observationBandModel(true), OBS_BAND);
+        drawBox(viewProj * observationBandModel(false), OBS_BAND);
+        for (int p = 0; p < state.pipeCount; p++) {
+            glm::mat4 bottom, top;
+            observationPipeModels(state, p, bottom, top);
+            drawBox(viewProj * bottom, OBS_PIPE);
+            drawBox(viewProj * top, OBS_PIPE);
+        }
+        drawBox(viewProj * observationBirdModel(state), OBS_BIRD);
+        glReadPixels(0, 0, OBS_WIDTH, OBS_HEIGHT, GL_RED, GL_UNSIGNED_BYTE, gpu.data());
+
+        renderObservations(&state, 1, cpu.data());
+        for (int y = 0; y < OBS_HEIGHT; y++) {
+            const unsigned char* gpuRow = &gpu[(OBS_HEIGHT - 1 - y) * OBS_WIDTH];
+            for (int x = 0; x < OBS_WIDTH; x++) mismatched += cpu[y * OBS_WIDTH + x] != gpuRow[x];
+        }
+    }
+
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteTextures(1, &texture);
+    glDeleteProgram(program);
+    return count > 0 ? (float)mismatched / ((size_t)count * OBS_WIDTH * OBS_HEIGHT) : 0.0f;
+}
+
+// Random but plausible states around the current game, for benchmarking and the GL check
+std::vector<ObservationState> randomObservationStates(int count, std::mt19937& gen) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<ObservationState> states(count);
+    for (ObservationState& state : states) {
+        state.birdY = -4.5f + 9.0f * unit(gen);
+        state.birdRotation = -90.0f + 120.0f * unit(gen);
+        state.cameraY = state.birdY * unit(gen);
+        state.pipeCount = 5;
+        float scroll = PIPE_DISTANCE * unit(gen);
+        for (int p = 0; p < state.pipeCount; p++) {
+            state.pipeX[p] = -PIPE_DISTANCE + p * PIPE_DISTANCE + scroll;
+            state.pipeGapY[p] = -3.0f + 6.0f * unit(gen);
+        }
+    }
+    return states;
+}
+
+// --obs-check: batched throughput and agreement with the GL reference
+void runObservationCheck(const GLTFMesh& cube) {
+    std::mt19937 gen(1234);
+    const int batch = 4096;
+    std::vector<ObservationState> states = randomObservationStates(batch, gen);
+    std::vector<unsigned char> tensor((size_t)batch * OBS_WIDTH * OBS_HEIGHT);
+    renderObservations(states.data(), batch, tensor.data()); // warm up
+    auto start = std::chrono::steady_clock::now();
+    const int rounds = 10;
+    for (int r = 0; r < rounds; r++) renderObservations(states.data(), batch, tensor.data());
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Observations: " << OBS_WIDTH << "x" << OBS_HEIGHT << " u8, batch " << batch << ", "
+              << (int)(batch * rounds / seconds) << " obs/s (" << seconds * 1e6 / (batch * rounds) << " us each)" << std::endl;
+
+    std::vector<ObservationState> checkStates = randomObservationStates(64, gen);
+    checkStates.push_back(currentObservationState());
+    float mismatch = compareObservationWithGL(checkStates.data(), (int)checkStates.size(), cube);
+    std::cout << "Observations vs GL: " << mismatch * 100.0f << "% of pixels differ over " << checkStates.size() << " states" << std::endl;
+}
+
+// GL Interception
+// --gl-stats and --gl-trace swap glad's function pointers for hooks once the
+// context exists. Every hook counts its call by kind before forwarding it, which
+// gives the F3 overlay and the exit summary the driver work per frame.
+// --gl-trace also records each call with its arguments and uploaded data to a
+// binary file. --gl-replay plays that file back on a fresh context with no game,
+// input or timing involved, so the same GPU work runs every time on any driver.
+// Only the functions in these lists are hooked: a new gl call must be added to
+// one of them (and GL_TRACE_VERSION bumped) or traces will be missing it.
+const char GL_TRACE_MAGIC[4] = {'F', 'G', 'L', 'T'};
+const uint32_t GL_TRACE_VERSION = 2;
+
+// Calls with plain value arguments: name, parameters, arguments, what each
+// argument names (see GL_NAME_KINDS; '-' is a plain value, 'L' a uniform
+// location of the program in use, 'I' a uniform block index of argument 0's
+// program) and the counter it adds to.
+#define GL_SCALAR_CALLS(X) \
+    X(AttachShader, (GLuint a, GLuint b), (a, b), "PS", other) \
+    X(BeginQuery, (GLenum a, GLuint b), (a, b), "-Q", other) \
+    X(BindBuffer, (GLenum a, GLuint b), (a, b), "-B", stateChanges) \
+    X(BindBufferBase, (GLenum a, GLuint b, GLuint c), (a, b, c), "--B", stateChanges) \
+    X(BindFramebuffer, (GLenum a, GLuint b), (a, b), "-F", stateChanges) \
+    X(BindRenderbuffer, (GLenum a, GLuint b), (a, b), "-R", stateChanges) \
+    X(BindTexture, (GLenum a, GLuint b), (a, b), "-T", textureBinds) \
+    X(BindVertexArray, (GLuint a), (a), "V", stateChanges) \
+    X(BlendFunc, (GLenum a, GLenum b), (a, b), "--", stateChanges) \
+    X(Clear, (GLbitfield a), (a), "-", other) \
+    X(ClearColor, (GLfloat a, GLfloat b, GLfloat c, GLfloat d), (a, b, c, d), "----", stateChanges) \
+    X(CompileShader, (GLuint a), (a), "S", other) \
+    X(DeleteProgram, (GLuint a), (a), "P", other) \
+    X(DeleteShader, (GLuint a), (a), "S", other) \
+    X(DepthFunc, (GLenum a), (a), "-", stateChanges) \
+    X(DepthMask, (GLboolean a), (a), "-", stateChanges) \
+    X(Disable, (GLenum a), (a), "-", stateChanges) \
+    X(DrawArrays, (GLenum a, GLint b, GLsizei c), (a, b, c), "---", draws) \
+    X(DrawArraysInstanced, (GLenum a, GLint b, GLsizei c, GLsizei d), (a, b, c, d), "----", draws) \
+    X(DrawElements, (GLenum a, GLsizei b, GLenum c, const void* d), (a, b, c, d), "----", draws) \
+    X(DrawElementsInstancedBaseVertex, (GLenum a, GLsizei b, GLenum c, const void* d, GLsizei e, GLint f), (a, b, c, d, e, f), "------", draws) \
+    X(Enable, (GLenum a), (a), "-", stateChanges) \
+    X(EnableVertexAttribArray, (GLuint a), (a), "-", stateChanges) \
+    X(EndQuery, (GLenum a), (a), "-", other) \
+    X(Finish, (), (), "", other) \
+    X(FramebufferRenderbuffer, (GLenum a, GLenum b, GLenum c, GLuint d), (a, b, c, d), "---R", other) \
+    X(FramebufferTexture2D, (GLenum a, GLenum b, GLenum c, GLuint d, GLint e), (a, b, c, d, e), "---T-", other) \
+    X(GenerateMipmap, (GLenum a), (a), "-", other) \
+    X(LinkProgram, (GLuint a), (a), "P", other) \
+    X(RenderbufferStorage, (GLenum a, GLenum b, GLsizei c, GLsizei d), (a, b, c, d), "----", other) \
+    X(TexParameteri, (GLenum a, GLenum b, GLint c), (a, b, c), "---", stateChanges) \
+    X(Uniform1f, (GLint a, GLfloat b), (a, b), "L-", uniforms) \
+    X(Uniform1i, (GLint a, GLint b), (a, b), "L-", uniforms) \
+    X(Uniform2f, (GLint a, GLfloat b, GLfloat c), (a, b, c), "L--", uniforms) \
+    X(Uniform3f, (GLint a, GLfloat b, GLfloat c, GLfloat d), (a, b, c, d), "L---", uniforms) \
+    X(Uniform4f, (GLint a, GLfloat b, GLfloat c, GLfloat d, GLfloat e), (a, b, c, d, e), "L----", uniforms) \
+    X(UniformBlockBinding, (GLuint a, GLuint b, GLuint c), (a, b, c), "PI-", other) \
+    X(UseProgram, (GLuint a), (a), "P", stateChanges) \
+    X(VertexAttribDivisor, (GLuint a, GLuint b), (a, b), "--", stateChanges) \
+    X(VertexAttribIPointer, (GLuint a, GLint b, GLenum c, GLsizei d, const void* e), (a, b, c, d, e), "-----", stateChanges) \
+    X(VertexAttribPointer, (GLuint a, GLint b, GLenum c, GLboolean d, GLsizei e, const void* f), (a, b, c, d, e, f), "------", stateChanges) \
+    X(Viewport, (GLint a, GLint b, GLsizei c, GLsizei d), (a, b, c, d), "----", stateChanges)
+
+// glGen*/glDelete* pairs and the kind of name they make
+#define GL_NAME_CALLS(X) \
+    X(Buffers, 'B') \
+    X(Textures, 'T') \
+    X(VertexArrays, 'V') \
+    X(Framebuffers, 'F') \
+    X(Renderbuffers, 'R') \
+    X(Queries, 'Q')
+
+// Calls with data, results or objects to track; their hooks are written out below
+#define GL_DATA_CALLS(X) \
+    X(CreateProgram) \
+    X(CreateShader) \
+    X(ShaderSource) \
+    X(BufferData) \
+    X(BufferSubData) \
+    X(TexImage2D) \
+    X(TexImage3D) \
+    X(TexSubImage3D) \
+    X(PixelStorei) \
+    X(UniformMatrix4fv) \
+    X(MultiDrawElementsBaseVertex) \
+    X(GetUniformLocation) \
+    X(GetUniformBlockIndex) \
+    X(FenceSync) \
+    X(ClientWaitSync) \
+    X(DeleteSync) \
+    X(ReadPixels) \
+    X(MapBufferRange) \
+    X(UnmapBuffer)
+
+// Reads from the driver: counted, but a replay has no use for them
+#define GL_QUERY_CALLS(X) \
+    X(CheckFramebufferStatus, GLenum, (GLenum a), (a)) \
+    X(GetIntegerv, void, (GLenum a, GLint* b), (a, b)) \
+    X(GetProgramInfoLog, void, (GLuint a, GLsizei b, GLsizei* c, GLchar* d), (a, b, c, d)) \
+    X(GetProgramiv, void, (GLuint a, GLenum b, GLint* c), (a, b, c)) \
+    X(GetQueryObjectiv, void, (GLuint a, GLenum b, GLint* c), (a, b, c)) \
+    X(GetQueryObjectui64v, void, (GLuint a, GLenum b, GLuint64* c), (a, b, c)) \
+    X(GetShaderInfoLog, void, (GLuint a, GLsizei b, GLsizei* c, GLchar* d), (a, b, c, d)) \
+    X(GetShaderiv, void, (GLuint a, GLenum b, GLint* c), (a, b, c)) \
+    X(GetString, const GLubyte*, (GLenum a), (a)) \
+    X(GetStringi, const GLubyte*, (GLenum a, GLuint b), (a, b))
+
+enum GLTraceOp {
+    GL_OP_Frame,
+#define GL_SCALAR_OP(name, params, args, kinds, counter) GL_OP_##name,
+    GL_SCALAR_CALLS(GL_SCALAR_OP)
+#undef GL_SCALAR_OP
+#define GL_NAME_OPS(name, kind) GL_OP_Gen##name, GL_OP_Delete##name,
+    GL_NAME_CALLS(GL_NAME_OPS)
+#undef GL_NAME_OPS
+#define GL_DATA_OP(name) GL_OP_##name,
+    GL_DATA_CALLS(GL_DATA_OP)
+#undef GL_DATA_OP
+};
+
+const char GL_NAME_KINDS[] = "BTVFRQPS"; // buffer, texture, vertex array, framebuffer, renderbuffer, query, program, shader
+const int GL_NAME_KIND_COUNT = 8;
+
+struct GLCallStats {
+    int calls = 0;
+    int draws = 0;
+    int stateChanges = 0;   // binds other than textures, enables, blend/depth/viewport state, attribute setup
+    int textureBinds = 0;
+    int uniforms = 0;
+    int uniformLookups = 0; // glGetUniformLocation and glGetUniformBlockIndex
+    int queries = 0;        // glGet* and status checks that read back from the driver
+    int other = 0;          // object setup, clears, syncs
+    long long bufferBytes = 0;
+    long long textureBytes = 0;
+
+    void add(const GLCallStats& frame) {
+        calls += frame.calls;
+        draws += frame.draws;
+        stateChanges += frame.stateChanges;
+        textureBinds += frame.textureBinds;
+        uniforms += frame.uniforms;
+        uniformLookups += frame.uniformLookups;
+        queries += frame.queries;
+        other += frame.other;
+        bufferBytes += frame.bufferBytes;
+        textureBytes += frame.textureBytes;
+    }
+};
+
+// Bytes of pixel data glTexImage/glReadPixels touch for the formats this game uses
+size_t glPixelDataSize(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, int alignment) {
+    int components = format == GL_RED ? 1 : format == GL_RG ? 2 : format == GL_RGB ? 3 : 4;
+    int componentSize = type == GL_FLOAT ? 4 : type == GL_HALF_FLOAT ? 2 : 1;
+    size_t row = (size_t)width * components * componentSize;
+    size_t stride = (row + alignment - 1) / alignment * alignment;
+    size_t rows = (size_t)height * depth;
+    return rows > 0 ? stride * (rows - 1) + row : 0;
+}
+
+inline uint64_t toTraceValue(GLfloat value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+inline uint64_t toTraceValue(const void* value) { return (uint64_t)(uintptr_t)value; }
+template <typename T> uint64_t toTraceValue(T value) { return (uint64_t)(int64_t)value; }
+
+template <typename T> T fromTraceValue(uint64_t value) { return (T)value; }
+template <> inline GLfloat fromTraceValue<GLfloat>(uint64_t value) {
+    uint32_t bits = (uint32_t)value;
+    GLfloat result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+template <> inline const void* fromTraceValue<const void*>(uint64_t value) { return (const void*)(uintptr_t)value; }
+
+// Commands are an op and 64-bit values; data goes as a byte count and the bytes.
+// They collect in memory and are written out at the end of each frame.
+struct GLTraceWriter {
+    std::ofstream file;
+    std::vector<unsigned char> buffer;
+    bool recording = false;
+    int frames = 0;
+    long long bytesWritten = 0;
+    int unpackAlignment = 4; // GL_UNPACK_ALIGNMENT, which sizes texture uploads
+    struct WriteMapping { void* data; size_t length; };
+    std::unordered_map<GLenum, WriteMapping> writeMappings; // by target, copied into the trace on unmap
+
+    bool start(const std::string& path, int width, int height) {
+        file.open(path, std::ios::binary);
+        if (!file) {
+            std::cout << "Failed to open GL trace file: " << path << std::endl;
+            return false;
+        }
+        buffer.insert(buffer.end(), GL_TRACE_MAGIC, GL_TRACE_MAGIC + 4);
+        uint32_t header[3] = {GL_TRACE_VERSION, (uint32_t)width, (uint32_t)height};
+        buffer.insert(buffer.end(), (const unsigned char*)header, (const unsigned char*)(header + 3));
+        recording = true;
+        return true;
+    }
+
+    void put(uint64_t value) {
+        const unsigned char* bytes = (const unsigned char*)&value;
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+    }
+
+    void op(GLTraceOp op) { put(op); }
+
+    void values() {}
+    template <typename T, typename... Rest>
+    void values(T value, Rest... rest) {
+        put(toTraceValue(value));
+        values(rest...);
+    }
+
+    void data(const void* bytes, size_t size) {
+        put(size);
+        buffer.insert(buffer.end(), (const unsigned char*)bytes, (const unsigned char*)bytes + size);
+    }
+
+    void endFrame() {
+        op(GL_OP_Frame);
+        frames++;
+        flush();
+    }
+
+    void flush() {
+        file.write((const char*)buffer.data(), buffer.size());
+        bytesWritten += buffer.size();
+        buffer.clear();
+    }
+
+    void finish(const std::string& path) {
+        if (!recording) return;
+        flush();
+        file.close();
+        recording = false;
+        std::cout << "GL trace: " << frames << " frames, " << bytesWritten / 1024 << " KB written to " << path << std::endl;
+    }
+};
+
+struct GLInterception {
+    bool installed = false;
+    GLCallStats frame;     // so far this frame
+    GLCallStats lastFrame; // the previous complete frame, for the overlay
+    GLCallStats total;     // all complete frames, for the exit summary
+    int frames = 0;
+    GLTraceWriter trace;
+
+    void endFrame() {
+        lastFrame = frame;
+        total.add(frame);
+        frames++;
+        frame = GLCallStats();
+        if (trace.recording) trace.endFrame();
+    }
+};
+
+GLInterception glInterception;
+
+#define GL_REAL_POINTER(name, ...) decltype(glad_gl##name) realGL##name = NULL;
+GL_SCALAR_CALLS(GL_REAL_POINTER)
+GL_DATA_CALLS(GL_REAL_POINTER)
+GL_QUERY_CALLS(GL_REAL_POINTER)
+#undef GL_REAL_POINTER
+#define GL_REAL_NAME_POINTERS(name, kind) decltype(glad_glGen##name) realGLGen##name = NULL; decltype(glad_glDelete##name) realGLDelete##name = NULL;
+GL_NAME_CALLS(GL_REAL_NAME_POINTERS)
+#undef GL_REAL_NAME_POINTERS
+
+#define GL_SCALAR_HOOK(name, params, args, kinds, counter) \
+    void APIENTRY hookGL##name params { \
+        glInterception.frame.calls++; \
+        glInterception.frame.counter++; \
+        if (glInterception.trace.recording) { \
+            glInterception.trace.op(GL_OP_##name); \
+            glInterception.trace.values args; \
+        } \
+        realGL##name args; \
+    }
+GL_SCALAR_CALLS(GL_SCALAR_HOOK)
+#undef GL_SCALAR_HOOK
+
+#define GL_NAME_HOOKS(name, kind) \
+    void APIENTRY hookGLGen##name(GLsizei n, GLuint* names) { \
+        glInterception.frame.calls++; \
+        glInterception.frame.other++; \
+        realGLGen##name(n, names); \
+        if (glInterception.trace.recording) { \
+            glInterception.trace.op(GL_OP_Gen##name); \
+            glInterception.trace.data(names, n * sizeof(GLuint)); \
+        } \
+    } \
+    void APIENTRY hookGLDelete##name(GLsizei n, const GLuint* names) { \
+        glInterception.frame.calls++; \
+        glInterception.frame.other++; \
+        if (glInterception.trace.recording) { \
+            glInterception.trace.op(GL_OP_Delete##name); \
+            glInterception.trace.data(names, n * sizeof(GLuint)); \
+        } \
+        realGLDelete##name(n, names); \
+    }
+GL_NAME_CALLS(GL_NAME_HOOKS)
+#undef GL_NAME_HOOKS
+
+#define GL_QUERY_HOOK(name, result, params, args) \
+    result APIENTRY hookGL##name params { \
+        glInterception.frame.calls++; \
+        glInterception.frame.queries++; \
+        return realGL##name args; \
+    }
+GL_QUERY_CALLS(GL_QUERY_HOOK)
+#undef GL_QUERY_HOOK
+
+GLTraceWriter* countGLCall(int GLCallStats::* counter) {
+    glInterception.frame.calls++;
+    glInterception.frame.*counter += 1;
+    return glInterception.trace.recording ? &glInterception.trace : NULL;
+}
+
+GLuint APIENTRY hookGLCreateProgram() {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    GLuint program = realGLCreateProgram();
+    if (trace) {
+        trace->op(GL_OP_CreateProgram);
+        trace->values(program);
+    }
+    return program;
+}
+
+GLuint APIENTRY hookGLCreateShader(GLenum type) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    GLuint shader = realGLCreateShader(type);
+    if (trace) {
+        trace->op(GL_OP_CreateShader);
+        trace->values(type, shader);
+    }
+    return shader;
+}
+
+void APIENTRY hookGLShaderSource(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    if (trace) {
+        trace->op(GL_OP_ShaderSource);
+        trace->values(shader, count);
+        for (GLsizei i = 0; i < count; i++) trace->data(strings[i], lengths && lengths[i] >= 0 ? lengths[i] : strlen(strings[i]));
+    }
+    realGLShaderSource(shader, count, strings, lengths);
+}
+
+void APIENTRY hookGLBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    if (data) glInterception.frame.bufferBytes += size;
+    if (trace) {
+        trace->op(GL_OP_BufferData);
+        trace->values(target, size, usage, data != NULL);
+        if (data) trace->data(data, size);
+    }
+    realGLBufferData(target, size, data, usage);
+}
+
+void APIENTRY hookGLBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    glInterception.frame.bufferBytes += size;
+    if (trace) {
+        trace->op(GL_OP_BufferSubData);
+        trace->values(target, offset);
+        trace->data(data, size);
+    }
+    realGLBufferSubData(target, offset, size, data);
+}
+
+// Texture data is always client memory here; nothing binds GL_PIXEL_UNPACK_BUFFER
+void traceTextureData(GLTraceWriter* trace, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels) {
+    size_t size = pixels ? glPixelDataSize(width, height, depth, format, type, glInterception.trace.unpackAlignment) : 0;
+    glInterception.frame.textureBytes += size;
+    if (!trace) return;
+    trace->values(pixels != NULL);
+    if (pixels) trace->data(pixels, size);
+}
+
+void APIENTRY hookGLTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    if (trace) {
+        trace->op(GL_OP_TexImage2D);
+        trace->values(target, level, internalFormat, width, height, border, format, type);
+    }
+    traceTextureData(trace, width, height, 1, format, type, pixels);
+    realGLTexImage2D(target, level, internalFormat, width, height, border, format, type, pixels);
+}
+
+void APIENTRY hookGLTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    if (trace) {
+        trace->op(GL_OP_TexImage3D);
+        trace->values(target, level, internalFormat, width, height, depth, border, format, type);
+    }
+    traceTextureData(trace, width, height, depth, format, type, pixels);
+    realGLTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, pixels);
+}
+
+void APIENTRY hookGLTexSubImage3D(GLenum target, GLint level, GLint x, GLint y, GLint z, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void* pixels) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    if (trace) {
+        trace->op(GL_OP_TexSubImage3D);
+        trace->values(target, level, x, y, z, width, height, depth, format, type);
+    }
+    traceTextureData(trace, width, height, depth, format, type, pixels);
+    realGLTexSubImage3D(target, level, x, y, z, width, height, depth, format, type, pixels);
+}
+
+void APIENTRY hookGLPixelStorei(GLenum name, GLint value) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::stateChanges);
+    if (name == GL_UNPACK_ALIGNMENT) glInterception.trace.unpackAlignment = value;
+    if (trace) {
+        trace->op(GL_OP_PixelStorei);
+        trace->values(name, value);
+    }
+    realGLPixelStorei(name, value);
+}
+
+void APIENTRY hookGLUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::uniforms);
+    if (trace) {
+        trace->op(GL_OP_UniformMatrix4fv);
+        trace->values(location, transpose);
+        trace->data(value, count * 16 * sizeof(GLfloat));
+    }
+    realGLUniformMatrix4fv(location, count, transpose, value);
+}
+
+void APIENTRY hookGLMultiDrawElementsBaseVertex(GLenum mode, const GLsizei* counts, GLenum type, const void* const* indices, GLsizei drawCount, const GLint* baseVertices) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::draws);
+    if (trace) {
+        trace->op(GL_OP_MultiDrawElementsBaseVertex);
+        trace->values(mode, type, drawCount);
+        for (GLsizei i = 0; i < drawCount; i++) trace->values(counts[i], indices[i], baseVertices[i]);
+    }
+    realGLMultiDrawElementsBaseVertex(mode, counts, type, indices, drawCount, baseVertices);
+}
+
+GLint APIENTRY hookGLGetUniformLocation(GLuint program, const GLchar* name) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::uniformLookups);
+    GLint location = realGLGetUniformLocation(program, name);
+    if (trace) {
+        trace->op(GL_OP_GetUniformLocation);
+        trace->values(program, location);
+        trace->data(name, strlen(name));
+    }
+    return location;
+}
+
+GLuint APIENTRY hookGLGetUniformBlockIndex(GLuint program, const GLchar* name) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::uniformLookups);
+    GLuint index = realGLGetUniformBlockIndex(program, name);
+    if (trace) {
+        trace->op(GL_OP_GetUniformBlockIndex);
+        trace->values(program, index);
+        trace->data(name, strlen(name));
+    }
+    return index;
+}
+
+GLsync APIENTRY hookGLFenceSync(GLenum condition, GLbitfield flags) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    GLsync sync = realGLFenceSync(condition, flags);
+    if (trace) {
+        trace->op(GL_OP_FenceSync);
+        trace->values(condition, flags, (const void*)sync);
+    }
+    return sync;
+}
+
+GLenum APIENTRY hookGLClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    if (trace) {
+        trace->op(GL_OP_ClientWaitSync);
+        trace->values((const void*)sync, flags, timeout);
+    }
+    return realGLClientWaitSync(sync, flags, timeout);
+}
+
+void APIENTRY hookGLDeleteSync(GLsync sync) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    if (trace) {
+        trace->op(GL_OP_DeleteSync);
+        trace->values((const void*)sync);
+    }
+    realGLDeleteSync(sync);
+}
+
+void APIENTRY hookGLReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    if (trace) {
+        // With a pack buffer bound the pointer is an offset into it, otherwise the replay reads into scratch memory
+        GLint packBuffer = 0;
+        realGLGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+        trace->op(GL_OP_ReadPixels);
+        trace->values(x, y, width, height, format, type, (const void*)pixels, packBuffer != 0);
+    }
+    realGLReadPixels(x, y, width, height, format, type, pixels);
+}
+
+void* APIENTRY hookGLMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    void* data = realGLMapBufferRange(target, offset, length, access);
+    if (trace) {
+        trace->op(GL_OP_MapBufferRange);
+        trace->values(target, offset, length, access);
+        if (data && (access & GL_MAP_WRITE_BIT)) trace->writeMappings[target] = {data, (size_t)length};
+    }
+    return data;
+}
+
+GLboolean APIENTRY hookGLUnmapBuffer(GLenum target) {
+    GLTraceWriter* trace = countGLCall(&GLCallStats::other);
+    if (trace) {
+        // Whatever was written through the mapping is only known now
+        trace->op(GL_OP_UnmapBuffer);
+        trace->values(target);
+        auto mapping = trace->writeMappings.find(target);
+        if (mapping != trace->writeMappings.end()) {
+            glInterception.frame.bufferBytes += mapping->second.length;
+            trace->data(mapping->second.data, mapping->second.length);
+            trace->writeMappings.erase(mapping);
+        } else {
+            trace->data(NULL, 0);
+        }
+    }
+    return realGLUnmapBuffer(target);
+}
+
+// Hooks every listed function. Call before any game resource is created so a
+// trace can rebuild them all; tracing also turns off the program binary cache,
+// whose loads bypass glad and so would not be recorded.
+bool installGLInterception(const std::string& tracePath, int width, int height) {
+    if (!tracePath.empty()) {
+        if (!glInterception.trace.start(tracePath, width, height)) return false;
+        programCache.supported = false;
+    }
+#define GL_INSTALL_HOOK(name, ...) realGL##name = glad_gl##name; glad_gl##name = hookGL##name;
+    GL_SCALAR_CALLS(GL_INSTALL_HOOK)
+    GL_DATA_CALLS(GL_INSTALL_HOOK)
+    GL_QUERY_CALLS(GL_INSTALL_HOOK)
+#undef GL_INSTALL_HOOK
+#define GL_INSTALL_NAME_HOOKS(name, kind) \
+    realGLGen##name = glad_glGen##name; glad_glGen##name = hookGLGen##name; \
+    realGLDelete##name = glad_glDelete##name; glad_glDelete##name = hookGLDelete##name;
+    GL_NAME_CALLS(GL_INSTALL_NAME_HOOKS)
+#undef GL_INSTALL_NAME_HOOKS
+    glInterception.installed = true;
+    return true;
+}
+
+// One line of per-frame averages for the exit summary
+void printGLCallStats() {
+    const GLCallStats& total = glInterception.total;
+    double frames = glm::max(glInterception.frames, 1);
+    char line[256];
+    snprintf(line, sizeof(line), "GL per frame over %d frames: %.1f calls, %.1f draws, %.1f state changes, %.1f texture binds, "
+             "%.1f uniforms, %.1f uniform lookups, %.1f KB buffer uploads, %.1f KB texture uploads",
+             glInterception.frames, total.calls / frames, total.draws / frames, total.stateChanges / frames, total.textureBinds / frames,
+             total.uniforms / frames, total.uniformLookups / frames, total.bufferBytes / frames / 1024.0, total.textureBytes / frames / 1024.0);
+    std::cout << line << std::endl;
+}
+
+// Trace playback: object names, uniform locations and syncs get new values on
+// this context, so the trace's values are mapped to them as they are created.
+// Framebuffer 0 and framebuffers made before the trace started stand for the
+// output, which here is whatever is bound when the replay begins.
+struct GLTraceReader {
+    const unsigned char* at;
+    const unsigned char* end;
+    bool failed = false;
+
+    uint64_t next() {
+        uint64_t value = 0;
+        if (end - at < (ptrdiff_t)sizeof(value)) {
+            failed = true;
+            at = end;
+            return 0;
+        }
+        memcpy(&value, at, sizeof(value));
+        at += sizeof(value);
+        return value;
+    }
+
+    const unsigned char* data(size_t& size) {
+        size = (size_t)next();
+        if ((size_t)(end - at) < size) {
+            failed = true;
+            at = end;
+            size = 0;
+        }
+        const unsigned char* bytes = at;
+        at += size;
+        return bytes;
+    }
+};
+
+struct GLReplay {
+    std::unordered_map<uint64_t, GLuint> names[GL_NAME_KIND_COUNT];
+    std::unordered_map<uint64_t, GLint> locations;     // (trace program << 32) | trace location
+    std::unordered_map<uint64_t, GLuint> blockIndices; // same key as locations
+    std::unordered_map<uint64_t, GLsync> syncs;
+    std::unordered_map<GLenum, void*> mappings;
+    uint64_t program = 0;   // trace name of the program in use
+    GLuint outputFBO = 0;
+    uint64_t args[8];       // current scalar call, as recorded
+    int unpackAlignment = 4; // as the trace last set it, to check texture data sizes
+    std::vector<unsigned char> scratch;
+
+    static uint64_t key(uint64_t program, uint64_t value) { return (program << 32) | (uint32_t)value; }
+
+    GLuint name(char kind, uint64_t value) {
+        int k = (int)(strchr(GL_NAME_KINDS, kind) - GL_NAME_KINDS);
+        auto found = names[k].find(value);
+        if (found != names[k].end()) return found->second;
+        return kind == 'F' ? outputFBO : (GLuint)value;
+    }
+
+    uint64_t remap(char kind, uint64_t value) {
+        if (kind == '-') return value;
+        if (kind == 'L') {
+            auto found = locations.find(key(program, value));
+            return toTraceValue(found != locations.end() ? found->second : -1);
+        }
+        if (kind == 'I') {
+            auto found = blockIndices.find(key(args[0], value));
+            return found != blockIndices.end() ? found->second : GL_INVALID_INDEX;
+        }
+        return name(kind, value);
+    }
+
+    void create(char kind, uint64_t traced, GLuint created) {
+        names[strchr(GL_NAME_KINDS, kind) - GL_NAME_KINDS][traced] = created;
+    }
+
+    // Names the trace deleted; ones it never created are left alone
+    std::vector<GLuint> release(char kind, const unsigned char* data, size_t size) {
+        std::unordered_map<uint64_t, GLuint>& map = names[strchr(GL_NAME_KINDS, kind) - GL_NAME_KINDS];
+        std::vector<GLuint> released;
+        for (size_t i = 0; i + sizeof(GLuint) <= size; i += sizeof(GLuint)) {
+            GLuint traced;
+            memcpy(&traced, data + i, sizeof(traced));
+            auto found = map.find(traced);
+            if (found == map.end()) continue;
+            released.push_back(found->second);
+            map.erase(found);
+        }
+        return released;
+    }
+};
 
-    unsigned char temp_bitmap[512*512];
-    stbtt_BakeFontBitmap(buffer.data(), 0, 32.0, temp_bitmap, 512, 512, 32, 96, cdata);
+template <typename... Args, size_t... I>
+void callWithTraceValues(void (APIENTRYP fn)(Args...), const uint64_t* values, std::index_sequence<I...>) {
+    fn(fromTraceValue<Args>(values[I])...);
+}
 
-    glGenTextures(1, &fontTexture);
-    glBindTexture(GL_TEXTURE_2D, fontTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, 512, 512, 0, GL_RED, GL_UNSIGNED_BYTE, temp_bitmap);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+template <typename... Args>
+bool replayScalar(void (APIENTRYP fn)(Args...), const char* kinds, GLTraceReader& reader, GLReplay& replay) {
+    const size_t count = sizeof...(Args);
+    uint64_t values[count + 1];
+    for (size_t i = 0; i < count; i++) replay.args[i] = reader.next();
+    if (reader.failed) return false;
+    for (size_t i = 0; i < count; i++) values[i] = replay.remap(kinds[i], replay.args[i]);
+    callWithTraceValues(fn, values, std::index_sequence_for<Args...>());
+    return true;
+}
 
-    glGenVertexArrays(1, &textVAO);
-    glGenBuffers(1, &textVBO);
-    glBindVertexArray(textVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+// Replays one frame's commands; false at the end of the trace or on a bad command.
+// Every command is read in full and checked before it reaches GL, so a truncated
+// or corrupt trace never hands the driver sizes its data does not cover.
+bool replayGLFrame(GLTraceReader& reader, GLReplay& replay, int& calls) {
+    while (reader.at < reader.end) {
+        GLTraceOp op = (GLTraceOp)reader.next();
+        size_t size;
+        const unsigned char* data;
+        switch (op) {
+        case GL_OP_Frame:
+            return true;
+#define GL_REPLAY_SCALAR(name, params, args, kinds, counter) \
+        case GL_OP_##name: \
+            if (!replayScalar(glad_gl##name, kinds, reader, replay)) return false; \
+            break;
+        GL_SCALAR_CALLS(GL_REPLAY_SCALAR)
+#undef GL_REPLAY_SCALAR
+#define GL_REPLAY_NAMES(name, kind) \
+        case GL_OP_Gen##name: { \
+            data = reader.data(size); \
+            if (reader.failed) return false; \
+            std::vector<GLuint> created(size / sizeof(GLuint)); \
+            glGen##name((GLsizei)created.size(), created.data()); \
+            for (size_t i = 0; i < created.size(); i++) { \
+                GLuint traced; \
+                memcpy(&traced, data + i * sizeof(GLuint), sizeof(traced)); \
+                replay.create(kind, traced, created[i]); \
+            } \
+            break; \
+        } \
+        case GL_OP_Delete##name: { \
+            data = reader.data(size); \
+            if (reader.failed) return false; \
+            std::vector<GLuint> released = replay.release(kind, data, size); \
+            glDelete##name((GLsizei)released.size(), released.data()); \
+            break; \
+        }
+        GL_NAME_CALLS(GL_REPLAY_NAMES)
+#undef GL_REPLAY_NAMES
+        case GL_OP_CreateProgram: {
+            uint64_t traced = reader.next();
+            if (reader.failed) return false;
+            replay.create('P', traced, glCreateProgram());
+            break;
+        }
+        case GL_OP_CreateShader: {
+            GLenum type = (GLenum)reader.next();
+            uint64_t traced = reader.next();
+            if (reader.failed) return false;
+            replay.create('S', traced, glCreateShader(type));
+            break;
+        }
+        case GL_OP_ShaderSource: {
+            GLuint shader = replay.name('S', reader.next());
+            GLsizei count = (GLsizei)reader.next();
+            std::vector<const GLchar*> strings;
+            std::vector<GLint> lengths;
+            for (GLsizei i = 0; i < count && !reader.failed; i++) {
+                data = reader.data(size);
+                strings.push_back((const GLchar*)data);
+                lengths.push_back((GLint)size);
+            }
+            if (reader.failed) return false;
+            glShaderSource(shader, (GLsizei)strings.size(), strings.data(), lengths.data());
+            break;
+        }
+        case GL_OP_BufferData: {
+            GLenum target = (GLenum)reader.next();
+            GLsizeiptr bufferSize = (GLsizeiptr)reader.next();
+            GLenum usage = (GLenum)reader.next();
+            data = reader.next() ? reader.data(size) : NULL;
+            if (data && size != (size_t)bufferSize) reader.failed = true;
+            if (reader.failed) return false;
+            glBufferData(target, bufferSize, data, usage);
+            break;
+        }
+        case GL_OP_BufferSubData: {
+            GLenum target = (GLenum)reader.next();
+            GLintptr offset = (GLintptr)reader.next();
+            data = reader.data(size);
+            if (reader.failed) return false;
+            glBufferSubData(target, offset, size, data);
+            break;
+        }
+        case GL_OP_TexImage2D:
+        case GL_OP_TexImage3D:
+        case GL_OP_TexSubImage3D: {
+            uint64_t v[10];
+            int count = op == GL_OP_TexImage2D ? 8 : op == GL_OP_TexImage3D ? 9 : 10;
+            for (int i = 0; i < count; i++) v[i] = reader.next();
+            data = reader.next() ? reader.data(size) : NULL;
+            int width = op == GL_OP_TexSubImage3D ? 5 : 3; // then height and depth; format and type come last
+            GLsizei depth = op == GL_OP_TexImage2D ? 1 : (GLsizei)v[width + 2];
+            if (data && size != glPixelDataSize((GLsizei)v[width], (GLsizei)v[width + 1], depth, (GLenum)v[count - 2], (GLenum)v[count - 1], replay.unpackAlignment)) {
+                reader.failed = true;
+            }
+            if (reader.failed) return false;
+            if (op == GL_OP_TexImage2D) glTexImage2D((GLenum)v[0], (GLint)v[1], (GLint)v[2], (GLsizei)v[3], (GLsizei)v[4], (GLint)v[5], (GLenum)v[6], (GLenum)v[7], data);
+            else if (op == GL_OP_TexImage3D) glTexImage3D((GLenum)v[0], (GLint)v[1], (GLint)v[2], (GLsizei)v[3], (GLsizei)v[4], (GLsizei)v[5], (GLint)v[6], (GLenum)v[7], (GLenum)v[8], data);
+            else glTexSubImage3D((GLenum)v[0], (GLint)v[1], (GLint)v[2], (GLint)v[3], (GLint)v[4], (GLsizei)v[5], (GLsizei)v[6], (GLsizei)v[7], (GLenum)v[8], (GLenum)v[9], data);
+            break;
+        }
+        case GL_OP_PixelStorei: {
+            GLenum name = (GLenum)reader.next();
+            GLint value = (GLint)reader.next();
+            if (reader.failed) return false;
+            if (name == GL_UNPACK_ALIGNMENT) replay.unpackAlignment = value;
+            glPixelStorei(name, value);
+            break;
+        }
+        case GL_OP_UniformMatrix4fv: {
+            GLint location = fromTraceValue<GLint>(replay.remap('L', reader.next()));
+            GLboolean transpose = (GLboolean)reader.next();
+            data = reader.data(size);
+            if (reader.failed) return false;
+            glUniformMatrix4fv(location, (GLsizei)(size / (16 * sizeof(GLfloat))), transpose, (const GLfloat*)data);
+            break;
+        }
+        case GL_OP_MultiDrawElementsBaseVertex: {
+            GLenum mode = (GLenum)reader.next();
+            GLenum type = (GLenum)reader.next();
+            GLsizei drawCount = (GLsizei)reader.next();
+            std::vector<GLsizei> counts;
+            std::vector<const void*> indices;
+            std::vector<GLint> baseVertices;
+            for (GLsizei i = 0; i < drawCount && !reader.failed; i++) {
+                counts.push_back((GLsizei)reader.next());
+                indices.push_back(fromTraceValue<const void*>(reader.next()));
+                baseVertices.push_back((GLint)reader.next());
+            }
+            if (reader.failed) return false;
+            glMultiDrawElementsBaseVertex(mode, counts.data(), type, indices.data(), (GLsizei)counts.size(), baseVertices.data());
+            break;
+        }
+        case GL_OP_GetUniformLocation:
+        case GL_OP_GetUniformBlockIndex: {
+            uint64_t program = reader.next();
+            uint64_t traced = reader.next();
+            data = reader.data(size);
+            if (reader.failed) return false;
+            std::string name((const char*)data, size);
+            uint64_t key = GLReplay::key(program, traced);
+            if (op == GL_OP_GetUniformLocation) replay.locations[key] = glGetUniformLocation(replay.name('P', program), name.c_str());
+            else replay.blockIndices[key] = glGetUniformBlockIndex(replay.name('P', program), name.c_str());
+            break;
+        }
+        case GL_OP_FenceSync: {
+            GLenum condition = (GLenum)reader.next();
+            GLbitfield flags = (GLbitfield)reader.next();
+            uint64_t traced = reader.next();
+            if (reader.failed) return false;
+            replay.syncs[traced] = glFenceSync(condition, flags);
+            break;
+        }
+        case GL_OP_ClientWaitSync: {
+            auto sync = replay.syncs.find(reader.next());
+            GLbitfield flags = (GLbitfield)reader.next();
+            GLuint64 timeout = reader.next();
+            if (reader.failed) return false;
+            if (sync != replay.syncs.end()) glClientWaitSync(sync->second, flags, timeout);
+            break;
+        }
+        case GL_OP_DeleteSync: {
+            auto sync = replay.syncs.find(reader.next());
+            if (reader.failed) return false;
+            if (sync != replay.syncs.end()) {
+                glDeleteSync(sync->second);
+                replay.syncs.erase(sync);
+            }
+            break;
+        }
+        case GL_OP_ReadPixels: {
+            uint64_t v[8];
+            for (int i = 0; i < 8; i++) v[i] = reader.next();
+            if (reader.failed) return false;
+            void* pixels = (void*)(uintptr_t)v[6];
+            if (!v[7]) {
+                replay.scratch.resize(glPixelDataSize((GLsizei)v[2], (GLsizei)v[3], 1, (GLenum)v[4], (GLenum)v[5], 8));
+                pixels = replay.scratch.data();
+            }
+            glReadPixels((GLint)v[0], (GLint)v[1], (GLsizei)v[2], (GLsizei)v[3], (GLenum)v[4], (GLenum)v[5], pixels);
+            break;
+        }
+        case GL_OP_MapBufferRange: {
+            GLenum target = (GLenum)reader.next();
+            GLintptr offset = (GLintptr)reader.next();
+            GLsizeiptr length = (GLsizeiptr)reader.next();
+            GLbitfield access = (GLbitfield)reader.next();
+            if (reader.failed) return false;
+            replay.mappings[target] = glMapBufferRange(target, offset, length, access);
+            break;
+        }
+        case GL_OP_UnmapBuffer: {
+            GLenum target = (GLenum)reader.next();
+            data = reader.data(size);
+            if (reader.failed) return false;
+            void* mapping = replay.mappings[target];
+            if (mapping && size > 0) memcpy(mapping, data, size);
+            replay.mappings.erase(target);
+            glUnmapBuffer(target);
+            break;
+        }
+        default:
+            reader.failed = true;
+        }
+        if (reader.failed) return false;
+        if (op == GL_OP_UseProgram) replay.program = replay.args[0];
+        calls++;
+    }
+    return false;
 }
 
-void RenderText(std::string text, float x, float y, float scale, glm::vec4 color) {
-    glUseProgram(textShaderProgram);
-    glUniform4f(glGetUniformLocation(textShaderProgram, "textColor"), color.x, color.y, color.z, color.w);
-    glUniform1i(glGetUniformLocation(textShaderProgram, "text"), 0);
-    
-    glm::mat4 projection = glm::ortho(0.0f, (float)SCR_WIDTH, (float)SCR_HEIGHT, 0.0f);
-    glUniformMatrix4fv(glGetUniformLocation(textShaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, fontTexture);
-    glBindVertexArray(textVAO);
+// Plays a trace into the bound framebuffer, finishing every frame so each one's
+// time is its whole CPU and GPU cost. Windowed builds show the frames as they go.
+bool replayGLTrace(const std::string& path, GLFWwindow* window, bool present) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    uint32_t header[3] = {};
+    if (bytes.size() < 16 || memcmp(bytes.data(), GL_TRACE_MAGIC, 4) != 0) {
+        std::cout << "Not a GL trace: " << path << std::endl;
+        return false;
+    }
+    memcpy(header, bytes.data() + 4, sizeof(header));
+    if (header[0] != GL_TRACE_VERSION) {
+        std::cout << "GL trace " << path << " is version " << header[0] << ", this build replays version " << GL_TRACE_VERSION << std::endl;
+        return false;
+    }
+    if ((int)header[1] != SCR_WIDTH || (int)header[2] != SCR_HEIGHT) {
+        std::cout << "GL trace was recorded at " << header[1] << "x" << header[2] << ", replaying at " << SCR_WIDTH << "x" << SCR_HEIGHT << std::endl;
+    }
 
-    for (char c : text) {
-        if (c < 32 || c >= 128) continue;
-        stbtt_aligned_quad q;
-        stbtt_GetBakedQuad(cdata, 512, 512, c-32, &x, &y, &q, 1);
+    GLTraceReader reader = {bytes.data() + 16, bytes.data() + bytes.size()};
+    GLReplay replay;
+    GLint outputFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &outputFBO);
+    replay.outputFBO = outputFBO;
 
-        float vertices[6][4] = {
-            { q.x0, q.y1, q.s0, q.t1 },
-            { q.x1, q.y0, q.s1, q.t0 },
-            { q.x0, q.y0, q.s0, q.t0 },
+    std::vector<double> frameTimes;
+    int calls = 0;
+    double start = glfwGetTime();
+    for (;;) {
+        double frameStart = glfwGetTime();
+        bool complete = replayGLFrame(reader, replay, calls);
+        glFinish();
+        if (!complete) break;
+        frameTimes.push_back(glfwGetTime() - frameStart);
+        if (present) glfwSwapBuffers(window);
+        glfwPollEvents();
+        if (glfwWindowShouldClose(window)) break;
+    }
+    double elapsed = glfwGetTime() - start;
+    if (reader.failed) {
+        std::cout << "GL trace " << path << " is truncated or corrupt after " << frameTimes.size() << " frames" << std::endl;
+        return false;
+    }
+    if (frameTimes.empty()) {
+        std::cout << "GL trace " << path << " has no complete frames" << std::endl;
+        return false;
+    }
 
-            { q.x0, q.y1, q.s0, q.t1 },
-            { q.x1, q.y1, q.s1, q.t1 },
-            { q.x1, q.y0, q.s1, q.t0 }
-        };
-        
-        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    // The first frame also creates every resource, so it is reported on its own
+    double first = frameTimes[0], total = 0.0, worst = 0.0, best = 1e9;
+    for (size_t i = 1; i < frameTimes.size(); i++) {
+        total += frameTimes[i];
+        worst = glm::max(worst, frameTimes[i]);
+        best = glm::min(best, frameTimes[i]);
     }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    size_t steady = frameTimes.size() - 1;
+    char summary[256];
+    snprintf(summary, sizeof(summary), "GL replay: %d frames, %d calls in %.3f s; first frame %.2f ms, then avg %.3f ms, min %.3f ms, max %.3f ms",
+             (int)frameTimes.size(), calls, elapsed, first * 1000.0, steady ? total / steady * 1000.0 : 0.0, steady ? best * 1000.0 : 0.0, worst * 1000.0);
+    std::cout << summary << " on " << glGetString(GL_RENDERER) << std::endl;
+    return true;
 }
 
-struct Button {
-    float x, y, w, h;
-    std::string text;
-    glm::vec4 color;
-    glm::vec4 hoverColor;
-    
-    bool isMouseOver(double mx, double my) {
-        return mx >= x && mx <= x + w && my >= y && my <= y + h;
+// Frame Pacing
+// Windowed frames are limited by vsync, an optional frame cap and, while the
+// game is static (menu, game over, minimized), a much lower idle rate. Waits
+// sleep in 1 ms steps while the remaining time is longer than a typical
+// oversleep, then spin for the rest, so the cap holds even with coarse OS timers.
+// Events are pumped between sleeps so input timestamps stay accurate.
+struct FramePacer {
+    double frameEnd = 0.0;     // when the previous frame was released
+    double sleepMean = 0.001;  // observed duration of a 1 ms sleep (Welford running stats)
+    double sleepM2 = 0.0;
+    long sleepCount = 1;
+
+    void sleepUntil(double target) {
+        while (target - glfwGetTime() > sleepMean + sqrt(sleepM2 / sleepCount)) {
+            glfwPollEvents();
+            double start = glfwGetTime();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            double observed = glfwGetTime() - start;
+            sleepCount++;
+            double delta = observed - sleepMean;
+            sleepMean += delta / sleepCount;
+            sleepM2 += delta * (observed - sleepMean);
+        }
+        while (glfwGetTime() < target) {}
+    }
+
+    // Pumps events and holds the frame until its interval is up. Idle waits
+    // block in glfwWaitEventsTimeout so input still wakes the loop at once;
+    // an idle rate of 0 waits for input indefinitely.
+    void endFrame(float maxFps, float idleFps, bool idle) {
+        double now = glfwGetTime();
+        if (idle && idleFps <= 0.0f) {
+            glfwWaitEvents();
+        } else if (idle) {
+            double remaining = frameEnd + 1.0 / idleFps - now;
+            if (remaining > 0.0) glfwWaitEventsTimeout(remaining);
+            else glfwPollEvents();
+        } else {
+            glfwPollEvents();
+            if (maxFps > 0.0f) {
+                double target = frameEnd + 1.0 / maxFps;
+                if (target > now) sleepUntil(target);
+            }
+        }
+        frameEnd = glfwGetTime();
     }
 };
 
-void RenderQuad(float x, float y, float w, float h, glm::vec4 color); // Forward declaration if needed, but definition is below
+// Launch Options
+struct LaunchOptions {
+    bool headless = false;
+    int frames = 300;           // headless frame count when not replaying
+    std::string screenshotPath; // PPM of the last frame, if set
+    std::string capturePath;    // every frame as .y4m or .ppm stream, if set (windowed too)
+    std::string recordPath;     // replay of the live session, written at exit
+    std::string replayPath;     // replay to render instead of live input
+    bool observationCheck = false; // benchmark the CPU observation renderer and compare it with GL
+    bool particleBenchmark = false; // time particle updates at 100k live
+    int animationBirds = 0;     // birds to animate in a timed benchmark, 0 for none
+    bool skyWall = false;       // draw the Flappy Sky wall even when its sprite sheet is missing
+    std::vector<std::string> cookPaths; // GLTF files to quantize and compress, then exit
+    bool glStats = false;       // count GL calls per frame (F3 and exit summary)
+    std::string glTracePath;    // binary trace of every GL call, if set
+    std::string glReplayPath;   // GL trace to play back and time instead of running the game
+    int swapInterval = 1;       // 0 off, 1 vsync, -1 adaptive (late frames tear instead of waiting)
+    float maxFps = 0.0f;        // frame cap on top of vsync, 0 for none
+    float idleFps = 10.0f;      // rate while nothing but the sky moves, 0 to wait for input
+    float renderBudgetMs = -1.0f; // scene GPU time to hold with dynamic resolution; 0 off, default 16 ms for live windowed play
+};
 
+LaunchOptions parseLaunchOptions(int argc, char** argv) {
+    LaunchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--headless") options.headless = true;
+        else if (arg == "--frames" && i + 1 < argc) options.frames = atoi(argv[++i]);
+        else if (arg == "--screenshot" && i + 1 < argc) options.screenshotPath = argv[++i];
+        else if (arg == "--capture" && i + 1 < argc) options.capturePath = argv[++i];
+        else if (arg == "--record" && i + 1 < argc) options.recordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) options.replayPath = argv[++i];
+        else if (arg == "--obs-check") options.observationCheck = true;
+        else if (arg == "--particle-bench") options.particleBenchmark = true;
+        else if (arg == "--anim-bench" && i + 1 < argc) options.animationBirds = atoi(argv[++i]);
+        else if (arg == "--sky-wall") options.skyWall = true;
+        else if (arg == "--cook" && i + 1 < argc) options.cookPaths.push_back(argv[++i]);
+        else if (arg == "--gl-stats") options.glStats = true;
+        else if (arg == "--gl-trace" && i + 1 < argc) options.glTracePath = argv[++i];
+        else if (arg == "--gl-replay" && i + 1 < argc) options.glReplayPath = argv[++i];
+        else if (arg == "--vsync" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            options.swapInterval = mode == "adaptive" ? -1 : atoi(mode.c_str());
+        }
+        else if (arg == "--fps-cap" && i + 1 < argc) options.maxFps = (float)atof(argv[++i]);
+        else if (arg == "--idle-fps" && i + 1 < argc) options.idleFps = (float)atof(argv[++i]);
+        else if (arg == "--render-budget" && i + 1 < argc) options.renderBudgetMs = (float)atof(argv[++i]);
+    }
+    return options;
+}
 
-void RenderQuad(float x, float y, float w, float h, glm::vec4 color) {
-    glUseProgram(textShaderProgram);
-    glUniform4f(glGetUniformLocation(textShaderProgram, "textColor"), color.x, color.y, color.z, color.w);
-    glUniform1i(glGetUniformLocation(textShaderProgram, "text"), 0);
-    
-    glm::mat4 projection = glm::ortho(0.0f, (float)SCR_WIDTH, (float)SCR_HEIGHT, 0.0f);
-    glUniformMatrix4fv(glGetUniformLocation(textShaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, whiteTexture);
-    glBindVertexArray(textVAO);
+// Headless Backend
+// For servers without a GPU or display: GLFW runs on its null platform for
+// time and input, while rendering goes to an offscreen framebuffer on a
+// surfaceless EGL context (Mesa llvmpipe works).
+#ifdef FLAPPY_HEADLESS
+struct HeadlessContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    unsigned int FBO = 0;
+    unsigned int colorRBO = 0;
+    unsigned int depthRBO = 0;
+};
 
-    float vertices[6][4] = {
-        { x,     y + h,   0.0f, 0.0f },
-        { x + w, y,       1.0f, 1.0f },
-        { x,     y,       0.0f, 1.0f },
+bool createHeadlessContext(HeadlessContext& headless) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) headless.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (headless.display == EGL_NO_DISPLAY) headless.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (headless.display == EGL_NO_DISPLAY || !eglInitialize(headless.display, NULL, NULL)) {
+        std::cout << "Failed to initialize EGL display" << std::endl;
+        return false;
+    }
 
-        { x,     y + h,   0.0f, 0.0f },
-        { x + w, y + h,   1.0f, 0.0f },
-        { x + w, y,       1.0f, 1.0f }
+    const EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_NONE };
+    EGLConfig config;
+    EGLint configCount = 0;
+    eglChooseConfig(headless.display, configAttribs, &config, 1, &configCount);
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
     };
-    
-    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
+    headless.context = eglCreateContext(headless.display, configCount > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+    if (headless.context == EGL_NO_CONTEXT || !eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, headless.context)) {
+        std::cout << "Failed to create surfaceless EGL context" << std::endl;
+        return false;
+    }
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return false;
+    }
+    programCache.init((GLADloadproc)eglGetProcAddress);
 
-void RenderBorder(float x, float y, float w, float h, glm::vec4 color) {
-    glUseProgram(textShaderProgram);
-    glUniform4f(glGetUniformLocation(textShaderProgram, "textColor"), color.x, color.y, color.z, color.w);
-    glUniform1i(glGetUniformLocation(textShaderProgram, "text"), 0);
-    
-    glm::mat4 projection = glm::ortho(0.0f, (float)SCR_WIDTH, (float)SCR_HEIGHT, 0.0f);
-    glUniformMatrix4fv(glGetUniformLocation(textShaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, whiteTexture);
-    glBindVertexArray(textVAO);
+    // Everything draws into this framebuffer; nothing else binds framebuffers
+    glGenRenderbuffers(1, &headless.colorRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless.colorRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT);
+    glGenRenderbuffers(1, &headless.depthRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless.depthRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT);
+    glGenFramebuffers(1, &headless.FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless.FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless.colorRBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, headless.depthRBO);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Headless framebuffer is incomplete" << std::endl;
+        return false;
+    }
+    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    return true;
+}
 
-    float vertices[4][4] = {
-        { x,     y,       0.0f, 0.0f },
-        { x + w, y,       1.0f, 0.0f },
-        { x + w, y + h,   1.0f, 1.0f },
-        { x,     y + h,   0.0f, 1.0f }
-    };
-    
-    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glLineWidth(2.0f);
-    glDrawArrays(GL_LINE_LOOP, 0, 4);
-    glLineWidth(1.0f);
-    
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+void destroyHeadlessContext(HeadlessContext& headless) {
+    if (headless.FBO) {
+        glDeleteFramebuffers(1, &headless.FBO);
+        glDeleteRenderbuffers(1, &headless.colorRBO);
+        glDeleteRenderbuffers(1, &headless.depthRBO);
+    }
+    if (headless.display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (headless.context != EGL_NO_CONTEXT) eglDestroyContext(headless.display, headless.context);
+        eglTerminate(headless.display);
+    }
 }
+#endif
 
-void RenderButton(Button& btn, double mx, double my) {
-    glm::vec4 color = btn.isMouseOver(mx, my) ? btn.hoverColor : btn.color;
-    RenderQuad(btn.x, btn.y, btn.w, btn.h, color);
-    RenderBorder(btn.x, btn.y, btn.w, btn.h, glm::vec4(1.0f));
-    
-    // Approximate text centering
-    float charWidth = 15.0f; // Approx width per character at scale 1.0
-    float textWidth = btn.text.length() * charWidth;
-    float textX = btn.x + (btn.w - textWidth) / 2.0f;
-    float textY = btn.y + (btn.h / 2.0f) - 5.0f; // Vertical adjustment
+// Writes the bound framebuffer as a binary PPM (rows flipped to top-down)
+bool saveScreenshot(const std::string& path) {
+    std::vector<unsigned char> pixels(SCR_WIDTH * SCR_HEIGHT * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, SCR_WIDTH, SCR_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to write screenshot: " << path << std::endl;
+        return false;
+    }
+    file << "P6\n" << SCR_WIDTH << " " << SCR_HEIGHT << "\n255\n";
+    for (int y = SCR_HEIGHT - 1; y >= 0; y--) file.write((const char*)&pixels[y * SCR_WIDTH * 3], SCR_WIDTH * 3);
+    return true;
+}
 
-    RenderText(btn.text, textX, textY, 1.0f, glm::vec4(1.0f));
+// First font that exists: FLAPPY_FONT, then the usual Windows and Linux locations
+std::string findFontPath() {
+    std::vector<std::string> candidates = {
+        "C:/Windows/Fonts/arial.ttf",
+        "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+        "/usr/share/fonts/TTF/DejaVuSans.ttf",
+        "/usr/share/fonts/dejavu/DejaVuSans.ttf",
+        "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf"
+    };
+    if (const char* env = getenv("FLAPPY_FONT")) candidates.insert(candidates.begin(), env);
+    for (const std::string& path : candidates) {
+        if (std::ifstream(path).good()) return path;
+    }
+    return candidates.front();
 }
 
-int main() {
+// Windowed GL 3.3 core context; NULL on failure
+GLFWwindow* createGameWindow() {
     // Init GLFW
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -644,39 +6385,92 @@ int main() {
     if (window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
-        return -1;
+        return NULL;
     }
     glfwMakeContextCurrent(window);
 
     // Init GLAD
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         std::cout << "Failed to initialize GLAD" << std::endl;
+        return NULL;
+    }
+    programCache.init((GLADloadproc)glfwGetProcAddress);
+    return window;
+}
+
+int main(int argc, char** argv) {
+    auto launchTime = std::chrono::steady_clock::now();
+    LaunchOptions options = parseLaunchOptions(argc, argv);
+    if (!options.cookPaths.empty()) {
+        bool cooked = true;
+        for (const std::string& path : options.cookPaths) cooked = cookGLTF(path) && cooked;
+        return cooked ? 0 : 1;
+    }
+    GLFWwindow* window = NULL;
+#ifdef FLAPPY_HEADLESS
+    HeadlessContext headless;
+    if (options.headless) {
+        // GLFW only provides time and (empty) input here; its window has no context
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+        glfwInit();
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "3D Flappy Bird", NULL, NULL);
+        if (window == NULL || !createHeadlessContext(headless)) {
+            std::cout << "Failed to create headless context" << std::endl;
+            destroyHeadlessContext(headless);
+            glfwTerminate();
+            return -1;
+        }
+    } else {
+        window = createGameWindow();
+    }
+#else
+    if (options.headless) {
+        std::cout << "Headless mode needs a build with -DFLAPPY_HEADLESS" << std::endl;
+        return -1;
+    }
+    window = createGameWindow();
+#endif
+    if (window == NULL) return -1;
+    glfwSetKeyCallback(window, keyCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
+
+    // Adaptive vsync needs the swap_control_tear extension, plain vsync otherwise
+    if (!options.headless) {
+        int interval = options.swapInterval;
+        if (interval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear")) interval = 1;
+        glfwSwapInterval(interval);
+    }
+
+    if (!options.glReplayPath.empty()) {
+        bool replayed = replayGLTrace(options.glReplayPath, window, !options.headless);
+        if (replayed && options.headless && !options.screenshotPath.empty()) saveScreenshot(options.screenshotPath);
+#ifdef FLAPPY_HEADLESS
+        if (options.headless) destroyHeadlessContext(headless);
+#endif
+        glfwTerminate();
+        return replayed ? 0 : 1;
+    }
+    if ((options.glStats || !options.glTracePath.empty()) && !installGLInterception(options.glTracePath, SCR_WIDTH, SCR_HEIGHT)) {
+#ifdef FLAPPY_HEADLESS
+        if (options.headless) destroyHeadlessContext(headless);
+#endif
+        glfwTerminate();
         return -1;
     }
 
     glEnable(GL_DEPTH_TEST);
 
     // Shader
-    unsigned int shaderProgram = createShaderProgram();
+    unsigned int shaderProgram = createShaderProgram(vertexShaderSource, fragmentShaderSource);
+    unsigned int bgShaderProgram = createShaderProgram(bgVertexShaderSource, bgFragmentShaderSource);
 
-    // Buffers
-    unsigned int VBO, VAO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
+    // Buffers (indexed compact cube shared by the background and pipes)
+    GLTFMesh cubeMesh = createCubeMesh();
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
-
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // Normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // TexCoord attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    // The background triangle is generated from gl_VertexID, but core profile still needs a VAO bound
+    unsigned int bgVAO;
+    glGenVertexArrays(1, &bgVAO);
 
     // Load Textures
     stbi_set_flip_vertically_on_load(true);
@@ -688,273 +6482,563 @@ int main() {
         "Resources/FlappyBird/sky/sky4.png"
     };
 
-    for (const auto& path : bgPaths) {
-        unsigned int tex = loadTexture(path.c_str());
-        bgTextures.push_back(tex);
-    }
-    
-    unsigned int pipeTexture = loadTexture("Resources/FlappyBird/pipe/Pipe.png");
+    // All skies live in one texture array, so changing background is just a layer uniform
+    skyTextureArray = loadTextureArray(bgPaths, skyLayerCount);
     
     // Load Bird Model
-    std::vector<GLTFMesh> birdMeshes = loadBirdModel("Resources/FlappyBird/bird/bird.gltf");
+    Skeleton birdSkeleton;
+    GLTFModel birdModel = loadGLTFModel(cookedAssetPath("Resources/FlappyBird/bird/bird.gltf"), birdSkeleton);
+    int glideClip = birdSkeleton.findClip("glide"), flapClip = birdSkeleton.findClip("flap"), crashClip = birdSkeleton.findClip("crash");
+    AnimationPlayer birdAnimation;
+    AnimationSampler birdSampler;
+    float lastFlapTime = bird.flapTime, animationSimTime = simTime;
+
+    // Joint palette for GPU skinning. Software rasterizers run the vertex shader
+    // on the CPU per draw anyway, so there the palette is applied once with SSE
+    // and the skinned vertices are streamed instead.
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    bool cpuSkinning = renderer && (strstr(renderer, "llvmpipe") || strstr(renderer, "softpipe") || strstr(renderer, "SwiftShader"));
+    unsigned int paletteUBO;
+    glGenBuffers(1, &paletteUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, paletteUBO);
+    glBufferData(GL_UNIFORM_BUFFER, MAX_JOINTS * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, paletteUBO);
+    glUniformBlockBinding(shaderProgram, glGetUniformBlockIndex(shaderProgram, "JointPalette"), 0);
+    if (cpuSkinning && birdModel.skinned) createCpuSkinBuffers(birdModel);
+
+    // Material colors of the merged bird, indexed by the per-vertex material slot
+    glBindBufferBase(GL_UNIFORM_BUFFER, 1, birdModel.materialUBO);
+    glUniformBlockBinding(shaderProgram, glGetUniformBlockIndex(shaderProgram, "Materials"), 1);
+
+    // Pipe: one body and cap from the pipe scene, drawn as instances with a
+    // per-instance gap edge and direction. The body below the cap is stretched
+    // to PIPE_LENGTH and the whole pipe scaled so the body is PIPE_WIDTH across.
+    Skeleton pipeSkeleton;
+    GLTFModel pipeModel = loadGLTFModel(cookedAssetPath("Resources/FlappyBird/pipe/Flappy Pipe.gltf"), pipeSkeleton, {0, 1});
+    unsigned int pipeInstanceVBO = 0;
+    glm::vec3 pipeBoxHalf(0.5f); // culling box in the unit pipe cube's space
+    if (!pipeModel.subMeshes.empty()) {
+        float top = -1e9f, bottom = 1e9f, halfWidth = 0.0f;
+        const SubMesh* body = &pipeModel.subMeshes[0];
+        for (const SubMesh& subMesh : pipeModel.subMeshes) {
+            top = glm::max(top, subMesh.boundsMax.y);
+            if (subMesh.boundsMin.y < bottom) {
+                bottom = subMesh.boundsMin.y;
+                body = &subMesh;
+            }
+            halfWidth = glm::max(halfWidth, glm::max(subMesh.boundsMax.x, -subMesh.boundsMin.x));
+        }
+        float stretchFrom = top;
+        for (const SubMesh& subMesh : pipeModel.subMeshes) {
+            if (subMesh.boundsMax.y > top - 0.001f) stretchFrom = glm::min(stretchFrom, subMesh.boundsMin.y);
+        }
+        float scale = PIPE_WIDTH / (body->boundsMax.x - body->boundsMin.x);
+        float stretch = (PIPE_LENGTH / scale - (top - stretchFrom)) / (stretchFrom - bottom);
+        glUseProgram(shaderProgram);
+        glUniform4f(glGetUniformLocation(shaderProgram, "pipeShape"), top, stretchFrom, scale, stretch);
+        pipeBoxHalf = glm::vec3(halfWidth * scale / PIPE_WIDTH, 0.5f, halfWidth * scale);
+
+        // Every primitive at full detail, the same ranges each frame
+        for (const SubMesh& subMesh : pipeModel.subMeshes) {
+            pipeModel.drawCounts.push_back(subMesh.lods[0].indexCount);
+            pipeModel.drawOffsets.push_back((const void*)(size_t)subMesh.lods[0].indexOffset);
+            pipeModel.drawBaseVertices.push_back(subMesh.baseVertex);
+        }
+
+        glBindVertexArray(pipeModel.VAO);
+        glGenBuffers(1, &pipeInstanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, pipeInstanceVBO);
+        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glEnableVertexAttribArray(6);
+        glVertexAttribDivisor(6, 1);
+        glBindVertexArray(0);
+    }
+
+    // Layered sky wall: all 20 panels baked into one static batch
+    std::string skyImagePath;
+    GLTFMesh skyBatch = loadStaticBatch(cookedAssetPath("Resources/FlappyBird/sky/Flappy Sky.gltf"), &skyImagePath);
+    unsigned int skyBatchTexture = skyImagePath.empty() ? 0 : loadTexture(skyImagePath);
+    // Without its sprite sheet the wall is only drawn on request, with a stand-in texture
+    bool drawSkyBatch = skyBatch.indexCount > 0 && (skyBatchTexture || options.skyWall);
+    if (!skyBatchTexture && drawSkyBatch) skyBatchTexture = loadTexture("Resources/FlappyBird/sky/sky4.png");
+    // The wall is modeled in the YZ plane; turn it to face the camera and center it behind the pipes
+    glm::mat4 skyBatchModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, -5.0f)) *
+                              glm::scale(glm::mat4(1.0f), glm::vec3(1.5f)) *
+                              glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)) *
+                              glm::translate(glm::mat4(1.0f), glm::vec3(-0.85f, -3.15f, 7.06f));
 
     // Init Text Renderer
-    initTextRenderer("C:/Windows/Fonts/arial.ttf");
-
-    // White texture for colored objects (Bird)
-    glGenTextures(1, &whiteTexture);
-    glBindTexture(GL_TEXTURE_2D, whiteTexture);
-    unsigned char white[] = {255, 255, 255};
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, white);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    initTextRenderer(findFontPath().c_str());
+
+    // Particle pool, allocated once for the whole run
+    particles.init();
+    particles.initGL();
+    if (options.particleBenchmark) runParticleBenchmark();
+    if (options.animationBirds > 0) runAnimationBenchmark(birdSkeleton, options.animationBirds);
+
+    // Atlas for the pipe, the white texel used by colored objects (Bird, UI quads) and the font
+    TextureAtlas atlas(1024, 1024);
+    int pipeWidth, pipeHeight, pipeComponents;
+    unsigned char* pipeData = stbi_load("Resources/FlappyBird/pipe/Pipe.png", &pipeWidth, &pipeHeight, &pipeComponents, 4);
+    if (pipeData) {
+        pipeRect = atlas.add(pipeData, pipeWidth, pipeHeight, 4);
+        stbi_image_free(pipeData);
+    } else {
+        std::cout << "Texture failed to load at path: Resources/FlappyBird/pipe/Pipe.png" << std::endl;
+    }
+    unsigned char white[4 * 4 * 4];
+    memset(white, 255, sizeof(white));
+    whiteRect = atlas.add(white, 4, 4, 4);
+    // Pipe material images; untextured slots keep a zero rect and fall back to the white texel
+    std::vector<glm::vec4> pipeMaterialRects(pipeModel.materialImages.size(), glm::vec4(0.0f));
+    std::unordered_map<std::string, glm::vec4> pipeImageRects;
+    for (size_t slot = 0; slot < pipeModel.materialImages.size(); slot++) {
+        const std::string& image = pipeModel.materialImages[slot];
+        if (image.empty()) continue;
+        if (!pipeImageRects.count(image)) {
+            int imageWidth, imageHeight, imageComponents;
+            unsigned char* imageData = stbi_load(image.c_str(), &imageWidth, &imageHeight, &imageComponents, 4);
+            if (!imageData) {
+                std::cout << "Texture failed to load at path: " << image << std::endl;
+                pipeImageRects[image] = glm::vec4(0.0f);
+                continue;
+            }
+            pipeImageRects[image] = atlas.add(imageData, imageWidth, imageHeight, 4);
+            stbi_image_free(imageData);
+        }
+        pipeMaterialRects[slot] = pipeImageRects[image];
+    }
+    if (!fontBitmap.empty()) fontRect = atlas.add(fontBitmap.data(), 512, 512, 1);
+    atlasTexture = atlas.upload();
+    if (pipeModel.materialUBO) setMaterialRects(pipeModel, pipeMaterialRects);
 
     // UI Elements
     Button startBtn = {300, 250, 200, 60, "START", glm::vec4(0.2f, 0.6f, 0.2f, 0.8f), glm::vec4(0.3f, 0.8f, 0.3f, 0.9f)};
     Button restartBtn = {300, 250, 200, 60, "RESTART", glm::vec4(0.8f, 0.2f, 0.2f, 0.8f), glm::vec4(1.0f, 0.3f, 0.3f, 0.9f)};
 
-    // Game State
-    rng.seed(time(0));
+    // Game State: a replay brings its own seed, live sessions record theirs
+    Replay replay;
+    replay.seed = (unsigned int)time(0);
+    if (!options.replayPath.empty()) {
+        if (!replay.load(options.replayPath)) return -1;
+        replaying = true;
+    }
+    rng.seed(replay.seed);
+
+    // Offline runs render at full resolution unless a budget is asked for
+    dynamicResolution.init(options.renderBudgetMs >= 0.0f ? options.renderBudgetMs : (options.headless || replaying) ? 0.0f : 16.0f);
+    renderQueue.onPassBegin = [](int pass) {
+        if (pass == PASS_UI) dynamicResolution.resolve();
+    };
 
     // Initialize pipes
     for (int i = 0; i < 5; i++) {
         pipes.emplace_back(PIPE_SPAWN_X + i * PIPE_DISTANCE, dist(rng));
     }
+    if (options.observationCheck) runObservationCheck(cubeMesh);
 
-    float lastFrame = 0.0f;
-    float lastBgChangeTime = 0.0f;
-
-    // Render Loop
-    while (!glfwWindowShouldClose(window)) {
-        float currentFrame = glfwGetTime();
-        float deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+    // Cold starts compile every program, warm ones load them all from the cache
+    programCache.save();
+    std::cout << "Startup: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launchTime).count() << " ms, "
+              << (programCache.compiled == 0 ? "warm" : programCache.fromCache == 0 ? "cold" : "partly warm") << " programs ("
+              << programCache.compiled << " compiled, " << programCache.fromCache << " cached, " << programCache.seconds * 1000.0 << " ms)"
+              << (programCache.supported ? "" : ", no program binary support") << std::endl;
 
-        // Auto-change background every 10 seconds
-        if (currentFrame - lastBgChangeTime >= 10.0f) {
-            if (!bgTextures.empty()) {
-                currentBgIndex = (currentBgIndex + 1) % bgTextures.size();
-            }
-            lastBgChangeTime = currentFrame;
-        }
+    float lastFrame = 0.0f;
+    float tickAccumulator = 0.0f;
+    size_t nextReplayEvent = 0;
+    std::vector<glm::mat4> pipeModels; // bottom/top pair per pipe, rebuilt each frame
+    std::vector<glm::vec4> pipeInstances; // visible halves of pipeModels
 
-        processInput(window);
+    FrameCapture capture;
+    bool capturing = !options.capturePath.empty() && capture.start(options.capturePath, SCR_WIDTH, SCR_HEIGHT);
 
-        // Update Game Logic
-        if (gameStarted && !gameOver) {
-            bird.update(deltaTime);
+    int framesRendered = 0;
+    double startTime = glfwGetTime();
+    FramePacer pacer;
 
-            // Move pipes
-            for (auto& pipe : pipes) {
-                pipe.x -= BIRD_SPEED * deltaTime;
+    // Turns input stamped up to 'until' into sim events for the coming tick
+    auto drainInput = [&](double until) {
+        while (const InputEvent* input = inputQueue.peek()) {
+            if (input->time > until) break;
+            if (input->type == INPUT_FLAP && !gameOver) {
+                queueSimEvent(EVENT_FLAP);
+                inputLatency.inputApplied(input->time);
+            } else if (input->type == INPUT_RESTART) {
+                queueSimEvent(EVENT_RESTART);
+            } else if (input->type == INPUT_CLICK) {
+                if (!gameStarted && startBtn.isMouseOver(input->x, input->y)) {
+                    queueSimEvent(EVENT_FLAP);
+                    inputLatency.inputApplied(input->time);
+                } else if (gameOver && restartBtn.isMouseOver(input->x, input->y)) {
+                    queueSimEvent(EVENT_RESTART_PLAYING);
+                }
             }
+            inputQueue.pop();
+        }
+    };
 
-            // Recycle pipes
-            if (pipes.front().x < -10.0f) {
-                pipes.erase(pipes.begin());
-                float lastX = pipes.back().x;
-                pipes.emplace_back(lastX + PIPE_DISTANCE, dist(rng));
-            }
+    // Render Loop
+    glInterception.frame = GLCallStats(); // loading is not part of any frame's count (the trace keeps it)
+    glState.invalidate(); // loading bound things directly
+    while (!glfwWindowShouldClose(window) && !(options.headless && !replaying && framesRendered >= options.frames) &&
+           !(replaying && simTick >= replay.endTick)) {
+        float now = glfwGetTime();
+        float deltaTime = now - lastFrame;
+        lastFrame = now;
 
-            // Score
-            for (auto& pipe : pipes) {
-                if (!pipe.passed && pipe.x < bird.position.x) {
-                    score++;
-                    pipe.passed = true;
-                }
-            }
+        processInput(window);
 
-            // Collision
-            for (const auto& pipe : pipes) {
-                if (checkCollision(bird, pipe)) {
-                    gameOver = true;
-                }
+        if (replaying) {
+            // One tick per rendered frame, as fast as the backend goes
+            while (nextReplayEvent < replay.events.size() && replay.events[nextReplayEvent].tick <= simTick) {
+                queuedEvents.push_back(replay.events[nextReplayEvent++]);
             }
-
-            // Ground/Ceiling collision
-            if (bird.position.y < -5.0f || bird.position.y > 5.0f) {
-                gameOver = true;
+            drainInput(now); // discarded: queueSimEvent ignores live input while replaying
+            stepSimulation();
+        } else {
+            // Catch the sim up to the wall clock, dropping time after long stalls
+            tickAccumulator = glm::min(tickAccumulator + deltaTime, 0.25f);
+            while (tickAccumulator >= SIM_DT) {
+                // Each tick takes the input stamped before the wall-clock time it ends at
+                drainInput(now - (tickAccumulator - SIM_DT));
+                stepSimulation();
+                tickAccumulator -= SIM_DT;
             }
-        } else if (gameOver) {
-             // Reset logic is now in processInput (R key) or Restart Button
         }
+        float currentFrame = simTime;
 
         // Render
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        dynamicResolution.beginScene();
+        glState.clearColor(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+        glState.depthMask(true); // the UI pass leaves whatever the background pass set
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glUseProgram(shaderProgram);
-
-        // Camera/View (Smooth Follow)
-        static float cameraY = 0.0f;
-        float targetY = bird.position.y;
-        // Clamp camera so it doesn't go too wild
-        if (targetY < -3.0f) targetY = -3.0f;
-        if (targetY > 3.0f) targetY = 3.0f;
-        
-        cameraY = glm::mix(cameraY, targetY, 2.0f * deltaTime); // Smooth lerp
-
-        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, cameraY, 14.0f), 
+        // Camera/View, following the bird as updated by the sim
+        glm::vec3 cameraPos(0.0f, cameraY, 14.0f);
+        glm::mat4 view = glm::lookAt(cameraPos, 
                                      glm::vec3(0.0f, cameraY, 0.0f), 
                                      glm::vec3(0.0f, 1.0f, 0.0f));
         
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         
-        unsigned int viewLoc = glGetUniformLocation(shaderProgram, "view");
-        unsigned int projLoc = glGetUniformLocation(shaderProgram, "projection");
-        unsigned int modelLoc = glGetUniformLocation(shaderProgram, "model");
-        unsigned int colorLoc = glGetUniformLocation(shaderProgram, "objectColor");
-        unsigned int lightColorLoc = glGetUniformLocation(shaderProgram, "lightColor");
-        unsigned int lightPosLoc = glGetUniformLocation(shaderProgram, "lightPos");
-        unsigned int viewPosLoc = glGetUniformLocation(shaderProgram, "viewPos");
-        unsigned int texOffsetLoc = glGetUniformLocation(shaderProgram, "texOffset");
-        unsigned int texScaleLoc = glGetUniformLocation(shaderProgram, "texScale");
-
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-        glUniform3f(lightColorLoc, 1.0f, 0.95f, 0.9f); // Warm sunlight
-        glUniform3f(lightPosLoc, 5.0f, 10.0f + cameraY, 10.0f); // Light follows camera Y
-        glUniform3f(viewPosLoc, 0.0f, cameraY, 14.0f);
+        // Per-frame uniforms; per-draw ones (model, color, texScale) travel with the draw packets
+        glState.useProgram(shaderProgram);
+        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        glUniform3f(glGetUniformLocation(shaderProgram, "lightColor"), 1.0f, 0.95f, 0.9f); // Warm sunlight
+        glUniform3f(glGetUniformLocation(shaderProgram, "lightPos"), 5.0f, 10.0f + cameraY, 10.0f); // Light follows camera Y
+        glUniform3f(glGetUniformLocation(shaderProgram, "viewPos"), cameraPos.x, cameraPos.y, cameraPos.z);
 
-        glBindVertexArray(VAO);
-
-        // Draw Background
-        glBindTexture(GL_TEXTURE_2D, bgTextures[currentBgIndex]);
-        glUniform3f(colorLoc, 1.0f, 1.0f, 1.0f);
-        
-        // Scroll background
-        float bgScroll = currentFrame * 0.05f; // Slower background for parallax
-        glUniform2f(texOffsetLoc, bgScroll, 0.0f);
-        glUniform2f(texScaleLoc, 1.0f, 1.0f);
+        glState.useProgram(particles.program);
+        glUniformMatrix4fv(glGetUniformLocation(particles.program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(particles.program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, cameraY * 0.8f, -10.0f)); // Parallax Y movement
-        model = glm::scale(model, glm::vec3(50.0f, 35.0f, 1.0f)); // Bigger background
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glState.useProgram(bgShaderProgram);
+        glUniform3f(glGetUniformLocation(bgShaderProgram, "lightColor"), 1.0f, 0.95f, 0.9f);
+        glUniform3f(glGetUniformLocation(bgShaderProgram, "lightPos"), 5.0f, 10.0f + cameraY, 10.0f);
+        glUniform3f(glGetUniformLocation(bgShaderProgram, "viewPos"), cameraPos.x, cameraPos.y, cameraPos.z);
 
-        // Reset texture offset for other objects
-        glUniform2f(texOffsetLoc, 0.0f, 0.0f);
+        float skyHalfHeight = tanf(glm::radians(45.0f) / 2.0f) * (14.0f + 9.5f);
+        glUniform2f(glGetUniformLocation(bgShaderProgram, "halfExtent"), skyHalfHeight * (float)SCR_WIDTH / (float)SCR_HEIGHT, skyHalfHeight);
+        glUniform1f(glGetUniformLocation(bgShaderProgram, "scroll"), currentFrame * 0.05f); // Slower background for parallax
+        glUniform1f(glGetUniformLocation(bgShaderProgram, "layer"), (float)currentBgIndex);
+        glUniform1f(glGetUniformLocation(bgShaderProgram, "previousLayer"), (float)previousBgIndex);
+        glUniform1f(glGetUniformLocation(bgShaderProgram, "fade"), glm::clamp((currentFrame - bgChangeTime) / BG_FADE_TIME, 0.0f, 1.0f));
 
         // Draw Bird
-        glBindTexture(GL_TEXTURE_2D, whiteTexture); // Use white texture so material colors show
-        glUniform2f(texScaleLoc, 1.0f, 1.0f);
+        DrawPacket packet = {};
+        packet.program = shaderProgram;
+        packet.texture = atlasTexture;
+        packet.atlasRect = whiteRect; // Use the white texel so material colors show
+        packet.mode = GL_TRIANGLES;
+        packet.texScale = glm::vec2(1.0f, 1.0f);
+
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, bird.position);
         
-        for (const auto& mesh : birdMeshes) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, bird.position);
-            
-            // Add a slight tilt based on velocity for "aerodynamics"
-            float tilt = bird.rotation;
-            model = glm::rotate(model, glm::radians(tilt), glm::vec3(0.0f, 0.0f, 1.0f));
-            
-            // Add a slight bank when moving up/down (3D effect)
-            float bank = bird.velocity * -2.0f; 
-            model = glm::rotate(model, glm::radians(bank), glm::vec3(1.0f, 0.0f, 0.0f));
-
-            // Adjust scale if needed. GLTF units are usually meters.
-            // If the bird is too big/small, adjust here.
-            model = glm::scale(model, glm::vec3(0.2f)); // Guessing scale
-            
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-            
-            if (gameOver) glUniform3f(colorLoc, 1.0f, 0.0f, 0.0f);
-            else glUniform3f(colorLoc, mesh.color.r, mesh.color.g, mesh.color.b);
-            
-            glBindVertexArray(mesh.VAO);
-            glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, 0);
-        }
-
-        // Draw Pipes
-        glBindVertexArray(VAO);
-        glBindTexture(GL_TEXTURE_2D, pipeTexture);
-        glUniform3f(colorLoc, 1.0f, 1.0f, 1.0f); // Use texture color
+        // Add a slight tilt based on velocity for "aerodynamics"
+        float tilt = bird.rotation;
+        model = glm::rotate(model, glm::radians(tilt), glm::vec3(0.0f, 0.0f, 1.0f));
+        
+        // Add a slight bank when moving up/down (3D effect)
+        float bank = bird.velocity * -2.0f; 
+        model = glm::rotate(model, glm::radians(bank), glm::vec3(1.0f, 0.0f, 0.0f));
+
+        // Adjust scale if needed. GLTF units are usually meters.
+        // If the bird is too big/small, adjust here.
+        const float birdScale = 0.2f;
+        model = glm::scale(model, glm::vec3(birdScale)); // Guessing scale
+
+        // Bird clip: crash once dead, flap after each jump, glide otherwise. A jump
+        // mid-flap restarts it; every switch crossfades from the current pose. The
+        // menu holds the bird still once any crossfade is done, so it can idle
+        bool posed = false;
+        if (!birdSkeleton.clips.empty()) {
+            int wanted = gameOver ? crashClip : (flapClip >= 0 && bird.flapTime < birdSkeleton.clips[flapClip].duration) ? flapClip : glideClip;
+            if (wanted == flapClip && bird.flapTime < lastFlapTime) birdAnimation.play(flapClip, 0.05f);
+            else if (wanted != birdAnimation.clip && wanted >= 0) birdAnimation.play(wanted, (wanted == crashClip) ? 0.1f : 0.25f);
+            lastFlapTime = bird.flapTime;
+            // Driven by sim time, so replays pose the bird the same way
+            bool animating = gameStarted || birdAnimation.finishing(birdSkeleton.clips);
+            if (birdAnimation.clip >= 0 && animating && birdAnimation.advance(birdSkeleton.clips, glm::max(0.0f, simTime - animationSimTime))) {
+                birdAnimation.sample(birdSkeleton.clips, birdSampler);
+                posed = birdSkeleton.applyPose(birdAnimation.pose);
+            }
+            animationSimTime = simTime;
+        }
+
+        // Joint palette, shared by every bird primitive. When the bird hasn't moved
+        // since last frame, the uploaded palette (or CPU-skinned buffer) still holds
+        bool skinOnCpu = birdModel.skinned && cpuSkinning;
+        if (!birdSkeleton.palette.empty() && posed) {
+            if (skinOnCpu) {
+                skinMeshCpu(birdModel.cpuSkin, birdSkeleton.palette);
+            } else {
+                glState.bindBuffer(GL_UNIFORM_BUFFER, paletteUBO);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, birdSkeleton.palette.size() * sizeof(glm::mat4), birdSkeleton.palette.data());
+            }
+        }
+
+        // Frustum culling: bounds of every bird submesh and pipe half, tested in one batch
+        pipeModels.clear();
         for (const auto& pipe : pipes) {
-            // Bottom pipe
-            float bottomHeight = 10.0f; // Arbitrary large height
-            float bottomY = pipe.gapY - PIPE_GAP/2 - bottomHeight/2;
-            
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(pipe.x, bottomY, 0.0f));
-            model = glm::scale(model, glm::vec3(PIPE_WIDTH, bottomHeight, 1.0f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-            glUniform2f(texScaleLoc, 1.0f, bottomHeight * 0.5f); // Scale texture by height
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-
-            // Top pipe
-            float topHeight = 10.0f;
-            float topY = pipe.gapY + PIPE_GAP/2 + topHeight/2;
-
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(pipe.x, topY, 0.0f));
-            model = glm::scale(model, glm::vec3(PIPE_WIDTH, topHeight, 1.0f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-            glUniform2f(texScaleLoc, 1.0f, topHeight * 0.5f); // Scale texture by height
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            float bottomY = pipe.gapY - PIPE_GAP/2 - PIPE_LENGTH/2;
+            float topY = pipe.gapY + PIPE_GAP/2 + PIPE_LENGTH/2;
+            pipeModels.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(pipe.x, bottomY, 0.0f)), glm::vec3(PIPE_WIDTH, PIPE_LENGTH, 1.0f)));
+            pipeModels.push_back(glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(pipe.x, topY, 0.0f)), glm::vec3(PIPE_WIDTH, PIPE_LENGTH, 1.0f)));
         }
+        frustumCuller.begin(projection * view);
+        for (const SubMesh& subMesh : birdModel.subMeshes) frustumCuller.add(model, subMesh.boundsMin, subMesh.boundsMax);
+        int firstPipeBox = (int)birdModel.subMeshes.size();
+        for (const glm::mat4& pipeBox : pipeModels) frustumCuller.add(pipeBox, -pipeBoxHalf, pipeBoxHalf);
+        frustumCuller.cull();
 
-        // UI Rendering
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        
-        // Mouse Input
-        double mx, my;
-        glfwGetCursorPos(window, &mx, &my);
-        static bool mousePressed = false;
-        bool click = false;
-        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-            if (!mousePressed) {
-                click = true;
-                mousePressed = true;
+        // Whole bird in one multi-draw: each visible submesh contributes its LOD for this distance
+        birdModel.drawCounts.clear();
+        birdModel.drawOffsets.clear();
+        birdModel.drawBaseVertices.clear();
+        for (int s = 0; s < (int)birdModel.subMeshes.size(); s++) {
+            const SubMesh& subMesh = birdModel.subMeshes[s];
+            if (!frustumCuller.visible[s]) continue;
+            const MeshLod* lod = selectLod(subMesh, birdScale, glm::distance(bird.position, cameraPos), glm::radians(45.0f), (float)dynamicResolution.height());
+            birdModel.drawCounts.push_back(lod->indexCount);
+            birdModel.drawOffsets.push_back((const void*)(size_t)lod->indexOffset);
+            birdModel.drawBaseVertices.push_back(subMesh.baseVertex);
+        }
+        if (!birdModel.drawCounts.empty()) {
+            packet.VAO = skinOnCpu ? birdModel.cpuSkin.VAO : birdModel.VAO;
+            packet.skinned = birdModel.skinned && !skinOnCpu;
+            packet.useMaterials = !gameOver;
+            packet.materialBlock = birdModel.materialUBO;
+            packet.indexType = birdModel.indexType;
+            packet.multiDrawCount = (int)birdModel.drawCounts.size();
+            packet.multiCounts = birdModel.drawCounts.data();
+            packet.multiOffsets = birdModel.drawOffsets.data();
+            packet.multiBaseVertices = birdModel.drawBaseVertices.data();
+            packet.model = model;
+            packet.color = gameOver ? glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) : glm::vec4(1.0f);
+            packet.key = makeSortKey(PASS_SCENE, packet.program, packet.texture, packet.VAO, glm::distance(bird.position, cameraPos) / 100.0f);
+            renderQueue.submit(packet);
+        }
+
+        // Draw Pipes: every visible half is an instance of the pipe model, so the
+        // draw count stays at one call per pipe primitive however many there are
+        packet.skinned = false;
+        packet.multiDrawCount = 0;
+        packet.color = glm::vec4(1.0f); // Use texture color
+        if (pipeInstanceVBO) {
+            pipeInstances.clear();
+            for (int p = 0; p < (int)pipeModels.size(); p++) {
+                if (!frustumCuller.visible[firstPipeBox + p]) continue;
+                const Pipe& pipe = pipes[p / 2];
+                bool bottomHalf = p % 2 == 0;
+                pipeInstances.push_back(glm::vec4(pipe.x, pipe.gapY + (bottomHalf ? -PIPE_GAP/2 : PIPE_GAP/2), bottomHalf ? 1.0f : -1.0f, 0.0f));
+            }
+            if (!pipeInstances.empty()) {
+                glState.bindBuffer(GL_ARRAY_BUFFER, pipeInstanceVBO);
+                glBufferData(GL_ARRAY_BUFFER, pipeInstances.size() * sizeof(glm::vec4), pipeInstances.data(), GL_STREAM_DRAW);
+
+                packet.VAO = pipeModel.VAO;
+                packet.useMaterials = true;
+                packet.materialBlock = pipeModel.materialUBO;
+                packet.atlasRect = whiteRect;
+                packet.texScale = glm::vec2(1.0f);
+                packet.model = glm::mat4(1.0f);
+                packet.indexType = pipeModel.indexType;
+                packet.instanceCount = (int)pipeInstances.size();
+                packet.multiDrawCount = (int)pipeModel.drawCounts.size();
+                packet.multiCounts = pipeModel.drawCounts.data();
+                packet.multiOffsets = pipeModel.drawOffsets.data();
+                packet.multiBaseVertices = pipeModel.drawBaseVertices.data();
+                packet.key = makeSortKey(PASS_SCENE, packet.program, packet.texture, packet.VAO, 0.0f);
+                renderQueue.submit(packet);
             }
         } else {
-            mousePressed = false;
+            // Textured cubes when the pipe model is missing
+            packet.VAO = cubeMesh.VAO;
+            packet.useMaterials = false;
+            packet.atlasRect = pipeRect;
+            packet.first = 0;
+            packet.count = cubeMesh.indexCount;
+            packet.indexType = cubeMesh.indexType;
+            packet.texScale = glm::vec2(1.0f, PIPE_LENGTH * 0.5f); // Scale texture by height
+            for (int p = 0; p < (int)pipeModels.size(); p++) {
+                if (!frustumCuller.visible[firstPipeBox + p]) continue;
+                packet.model = pipeModels[p];
+                packet.key = makeSortKey(PASS_SCENE, packet.program, packet.texture, packet.VAO, glm::distance(glm::vec3(pipeModels[p][3]), cameraPos) / 100.0f);
+                renderQueue.submit(packet);
+            }
+        }
+
+        // Every live particle in one instanced draw
+        if (particles.count > 0) {
+            particles.upload();
+            packet = {};
+            packet.program = particles.program;
+            packet.VAO = particles.VAO;
+            packet.mode = GL_TRIANGLE_STRIP;
+            packet.count = 4;
+            packet.instanceCount = particles.count;
+            packet.key = makeSortKey(PASS_SCENE, packet.program, packet.texture, packet.VAO, 0.0f);
+            renderQueue.submit(packet);
+        }
+
+        // Sky wall, the whole static batch in one draw
+        if (drawSkyBatch) {
+            packet = {};
+            packet.program = shaderProgram;
+            packet.texture = skyBatchTexture;
+            packet.VAO = skyBatch.VAO;
+            packet.mode = GL_TRIANGLES;
+            packet.count = skyBatch.indexCount;
+            packet.indexType = skyBatch.indexType;
+            packet.model = skyBatchModel;
+            packet.color = glm::vec4(1.0f);
+            packet.texScale = glm::vec2(1.0f);
+            packet.atlasRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f); // own texture, not the atlas
+            packet.key = makeSortKey(PASS_SCENE, packet.program, packet.texture, packet.VAO, glm::distance(glm::vec3(skyBatchModel[3]), cameraPos) / 100.0f);
+            renderQueue.submit(packet);
         }
 
+        // Draw Background in its own pass after the scene, at the far plane,
+        // so early-Z rejects every pixel already covered by the bird and pipes
+        packet = {};
+        packet.program = bgShaderProgram;
+        packet.textureTarget = GL_TEXTURE_2D_ARRAY;
+        packet.texture = skyTextureArray;
+        packet.VAO = bgVAO;
+        packet.mode = GL_TRIANGLES;
+        packet.count = 3;
+        packet.key = makeSortKey(PASS_BACKGROUND, packet.program, packet.texture, packet.VAO, 1.0f);
+        renderQueue.submit(packet);
+
+        // UI Rendering
+        // Mouse Input
+        double mx, my;
+        glfwGetCursorPos(window, &mx, &my); // hover only; clicks come through the input queue
+
         if (!gameStarted) {
             RenderText("FLAPPY BIRD 3D", 250, 400, 1.0f, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
             RenderButton(startBtn, mx, my);
-            if (click && startBtn.isMouseOver(mx, my)) {
-                gameStarted = true;
-                bird.jump();
-            }
         } else if (gameOver) {
             RenderText("GAME OVER", 300, 350, 1.0f, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
             RenderText("Score: " + std::to_string(score), 350, 320, 1.0f, glm::vec4(1.0f));
             RenderText("Press R to Restart", 300, 250, 0.5f, glm::vec4(1.0f));
             RenderButton(restartBtn, mx, my);
-            if (click && restartBtn.isMouseOver(mx, my)) {
-                gameOver = false;
-                gameStarted = true;
-                bird.reset();
-                score = 0;
-                pipes.clear();
-                
-                // Change background randomly
-                static std::uniform_int_distribution<int> bgDist(0, 100);
-                if (!bgTextures.empty()) {
-                    currentBgIndex = bgDist(rng) % bgTextures.size();
-                }
+        } else {
+            RenderText("Score: " + std::to_string(score), 10, 30, 1.0f, glm::vec4(1.0f));
+        }
 
-                for (int i = 0; i < 5; i++) {
-                    pipes.emplace_back(PIPE_SPAWN_X + i * PIPE_DISTANCE, dist(rng));
-                }
+        if (showStats) {
+            // Counters from the previous flush
+            std::string stats = "draws " + std::to_string(frameStats.draws) +
+                                "  binds " + std::to_string(frameStats.programBinds + frameStats.textureBinds + frameStats.vaoBinds) +
+                                "  skipped " + std::to_string(glState.lastSkipped) +
+                                "  tris " + std::to_string(frameStats.triangles) +
+                                "  visible " + std::to_string(frustumCuller.visibleCount) +
+                                "  culled " + std::to_string(frustumCuller.culledCount) +
+                                "  particles " + std::to_string(particles.count);
+            if (dynamicResolution.enabled) {
+                char resolution[64];
+                snprintf(resolution, sizeof(resolution), "  res %d%%  scene %.1f ms", (int)(dynamicResolution.scale * 100.0f + 0.5f), dynamicResolution.gpuMs);
+                stats += resolution;
             }
+            RenderText(stats, 10, SCR_HEIGHT - 10, 0.5f, glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
+            char latency[128];
+            snprintf(latency, sizeof(latency), "flap to present  last %.1f ms  avg %.1f ms  max %.1f ms",
+                     inputLatency.last * 1000.0f, inputLatency.average * 1000.0f, inputLatency.worst * 1000.0f);
+            RenderText(latency, 10, SCR_HEIGHT - 34, 0.5f, glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
+            if (glInterception.installed) {
+                const GLCallStats& gl = glInterception.lastFrame;
+                char calls[160];
+                snprintf(calls, sizeof(calls), "gl calls %d  draws %d  state %d  tex binds %d  lookups %d  upload %.1f KB",
+                         gl.calls, gl.draws, gl.stateChanges, gl.textureBinds, gl.uniformLookups, (gl.bufferBytes + gl.textureBytes) / 1024.0);
+                RenderText(calls, 10, SCR_HEIGHT - 58, 0.5f, glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
+            }
+        }
+
+        UploadUIVertices();
+        renderQueue.flush();
+        dynamicResolution.resolve(); // in case nothing drew in the UI pass
+
+        if (capturing) capture.captureFrame();
+        if (glInterception.installed) glInterception.endFrame();
+        glState.endFrame();
+        framesRendered++;
+        if (options.headless || replaying) {
+            // Offline runs go as fast as they can
+            if (!options.headless) glfwSwapBuffers(window);
+            glfwPollEvents();
         } else {
-            RenderText("Score: " + std::to_string(score), 10, 30, 1.0f, glm::vec4(1.0f));
+            glfwSwapBuffers(window);
+            inputLatency.presented(glfwGetTime());
+            // Menu and game over only idle once the crash debris and the crash clip have settled
+            bool settling = particles.count > 0 || birdAnimation.finishing(birdSkeleton.clips);
+            bool idle = glfwGetWindowAttrib(window, GLFW_ICONIFIED) || ((!gameStarted || gameOver) && !settling);
+            pacer.endFrame(options.maxFps, options.idleFps, idle);
         }
-        glDisable(GL_BLEND);
+    }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    if (options.headless) glFinish();
+    double elapsed = glfwGetTime() - startTime;
+    if (capturing) capture.finish();
+    if (!replaying && !options.recordPath.empty()) {
+        replay.events = recordedEvents;
+        replay.endTick = simTick;
+        if (replay.save(options.recordPath)) std::cout << "Recorded " << simTick << " ticks to " << options.recordPath << ", final score " << score << std::endl;
+    }
+    if (replaying) {
+        std::cout << "Replay: " << simTick << " ticks (" << simTime << " s of game time) rendered in " << elapsed << " s, "
+                  << simTime / glm::max(elapsed, 1e-9) << "x real time, final score " << score << std::endl;
+    }
+    if (options.headless) {
+        std::cout << "Headless: " << framesRendered << " frames in " << elapsed << " s ("
+                  << (elapsed > 0.0 ? framesRendered / elapsed : 0.0) << " fps) on " << glGetString(GL_RENDERER) << std::endl;
+        if (dynamicResolution.enabled) {
+            std::cout << "Dynamic resolution: scale " << dynamicResolution.scale << ", scene " << dynamicResolution.gpuMs << " ms against a " << dynamicResolution.budgetMs << " ms budget" << std::endl;
+        }
+        if (!options.screenshotPath.empty()) saveScreenshot(options.screenshotPath);
     }
+    if (glInterception.installed) printGLCallStats();
+    glInterception.trace.finish(options.glTracePath);
 
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    programCache.save();
+    dynamicResolution.destroy();
+    particles.destroy();
+    destroyMesh(cubeMesh);
+    if (skyBatch.indexCount > 0) destroyMesh(skyBatch);
+    if (skyBatchTexture) glDeleteTextures(1, &skyBatchTexture);
+    destroyModel(birdModel);
+    glDeleteVertexArrays(1, &bgVAO);
+    glDeleteBuffers(1, &paletteUBO);
     glDeleteProgram(shaderProgram);
+    glDeleteProgram(bgShaderProgram);
 
+#ifdef FLAPPY_HEADLESS
+    if (options.headless) destroyHeadlessContext(headless);
+#endif
     glfwTerminate();
     return 0;
 }